@@ -1,5 +1,17 @@
 #include "include/RBTree.hpp"
 #include "include/HashMap.hpp"
+#include "include/SkipList.hpp"
+#include "include/BPlusTree.hpp"
+#include "include/Deque.hpp"
+#include "include/PriorityQueue.hpp"
+#include "include/StripedHashMap.hpp"
+#include "include/LockFreeHashMap.hpp"
+#include "include/RWLockTree.hpp"
+#include "include/LockFreeSkipList.hpp"
+#include "include/Workload.hpp"
+#include "include/LatencyHistogram.hpp"
+#include "include/Affinity.hpp"
+#include "include/Results.hpp"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -11,6 +23,7 @@
 #include <cstdlib>
 #include <boost/program_options.hpp>
 #include <fstream>
+#include <unistd.h>
 namespace po = boost::program_options;
 
 using namespace std;
@@ -18,160 +31,547 @@ using std::chrono::high_resolution_clock;
 using std::chrono::duration_cast;
 using std::chrono::duration;
 using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
 
 std::ofstream outfile;
+// every report() of this run, one per trial
+vector<TrialResult> trialResults;
 
-enum OperationType { PUT, DELETE, GET };
-typedef struct Operation {
-    OperationType op_type;
-    int64_t key;
-} Operation;
+// How bench measures the op stream benchmarks
+struct RunOptions {
+    double warmup = 0; // seconds of untimed ops before measuring
+    double duration = 0; // if set, measure for this many seconds instead of running every op once
+    bool latency = false; // per op latency histograms
+    vector<int> cpus; // thread i is pinned to cpus[i % cpus.size()], empty to not pin
+};
 
-/**
- * @brief Benchmarking for HashMap
- * 
- * @param totalOps Total operations to benchmark
- * @param keyMin Min value in key range
- * @param keyMax Max value in key range
- * @param puts Proportion of puts
- * @param deletes Proportion of deletes
- * @param gets Proportion of gets
- */
-void hashbenchmark(int totalOps, int numThreads, int keyMin, int keyMax, double puts, double deletes, double gets){
-    HashMap m((int)((keyMax - keyMin) * 0.75));
-    vector<Operation> ops;
-    for(int i = 0; i < totalOps; i++){
-        int key = (rand() % (keyMax - keyMin)) + keyMin;
-        double type = rand() / double(RAND_MAX);
-        if(type < puts){
-            ops.push_back(Operation{PUT, key});
-            // rb.insert(key);
-        } else if(type < puts + deletes){
-            ops.push_back(Operation{DELETE, key});
-            // rb.deleteKey(key);
-        } else{
-            ops.push_back(Operation{GET, key});
-            // rb.contains(key);
-        }
+// One shot barrier. Threads spin, so they all leave close together, but
+// yield while spinning in case there are more threads than CPUs
+class SpinBarrier {
+    atomic<int> waiting;
+
+public:
+    SpinBarrier(int count) : waiting(count) {}
+
+    void arriveAndWait()
+    {
+        waiting.fetch_sub(1);
+        while (waiting.load() > 0)
+            this_thread::yield();
     }
+};
 
-    assert(ops.size() == (size_t) totalOps);
+enum Phase { WARMUP, MEASURE, STOP };
 
-    // Shuffle operations
-    auto rng = default_random_engine {};
-    shuffle(begin(ops), end(ops), rng);
-    cout << "Starting benchmark" << endl;
-    auto t1 = high_resolution_clock::now();
+// Prints and records throughput, aborts, and latency percentiles if any were recorded
+void report(int64_t totalOps, duration<double> elapsed, int numThreads, const LatencyHistogram& latency, int64_t attempts, int64_t aborts){
+    duration<double, std::milli> ms_double = elapsed;
+    TrialResult r;
+    r.seconds = elapsed.count();
+    r.ops = totalOps;
+    r.kops = (totalOps / elapsed.count()) / 1000.0;
+    r.hasLatency = latency.count() > 0;
+    r.p50 = latency.percentile(50);
+    r.p99 = latency.percentile(99);
+    r.p999 = latency.percentile(99.9);
+    r.maxLatency = latency.maxLatency();
+    r.attempts = attempts;
+    r.aborts = aborts;
+    trialResults.push_back(r);
+
+    cout << "Threads: " << numThreads << endl;
+    cout << "\t" << ms_double.count() << "ms\n";
+    cout << "\t" << r.kops << " 1000x ops per second\n";
+    cout << "\t" << aborts << " aborts in " << attempts << " transactions begun\n";
+    if (r.hasLatency) {
+        cout << "\tlatency ns: p50 " << r.p50 << " p99 " << r.p99
+             << " p99.9 " << r.p999 << " max " << r.maxLatency << "\n";
+    }
+    outfile << r.kops << endl;
+}
+
+/**
+ * @brief Runs a workload on numThreads threads and reports the results
+ * 
+ * Every thread pins itself, builds its own op stream (see generateThreadOps)
+ * and then waits on a barrier with the others, so neither thread start up
+ * nor stream generation is timed, and each stream is local to its thread.
+ * During the warm-up and in duration mode a thread starts over at its first
+ * op when it runs out.
+ * 
+ * @param doOp doOp(ops) runs ops[0..txSize) as a whole transaction. Latency
+ *             is taken around the call, so it includes every retry
+ * @param txSize Ops per transaction, w.numOps counts transactions
+ */
+template <typename F>
+void runOps(const Workload& w, int numThreads, const RunOptions& opts, F doOp, int txSize = 1){
+    atomic<int> phase { opts.warmup > 0 ? WARMUP : MEASURE };
+    vector<LatencyHistogram> latencies(numThreads);
+    vector<int64_t> measured(numThreads, 0), attempts(numThreads, 0), aborts(numThreads, 0);
+    SpinBarrier ready(numThreads + 1);
     vector<thread> workers;
     // Spawn threads
     for (int thread_id = 0; thread_id < numThreads; thread_id++) {
-        workers.push_back(thread([&m, thread_id, numThreads, totalOps, ops]() {
-            for (int i = thread_id; i < totalOps; i += numThreads) {
-                // cout << "worker " << thread_id << " doing op "  << i << "\n";
-                Operation op = ops[i];
-                if(op.op_type == PUT){
-                    TxBegin();
-                    m.put(op.key, 0);
-                    TxEnd();
-                } else if(op.op_type == DELETE){
-                    TxBegin();
-                    m.remove(op.key);
-                    TxEnd();
-                } else if(op.op_type == GET){
-                    TxBegin();
-                    int64_t res;
-                    m.get(op.key, res);
-                    TxEnd();
+        workers.push_back(thread([&, thread_id]() {
+            if (!opts.cpus.empty() && !pinThisThread(opts.cpus[thread_id % opts.cpus.size()]))
+                cout << "failed to pin thread " << thread_id << endl;
+            vector<Operation> ops = generateThreadOps(w, thread_id, numThreads, txSize);
+            int64_t totalOps = ops.size();
+            ready.arriveAndWait();
+            if (totalOps == 0)
+                return;
+            int64_t i = 0;
+            while (phase.load(memory_order_relaxed) == WARMUP) {
+                doOp(&ops[i]);
+                i += txSize;
+                if (i == totalOps)
+                    i = 0;
+            }
+            int64_t n = 0;
+            int txBefore = _my_thread.txCount;
+            int64_t abortsBefore = _my_thread.numAborts;
+            for (i = 0;; i += txSize) {
+                if (opts.duration > 0) {
+                    if (phase.load(memory_order_relaxed) == STOP)
+                        break;
+                    if (i == totalOps)
+                        i = 0;
+                } else if (i == totalOps) {
+                    break;
                 }
-
+                if (opts.latency) {
+                    auto start = high_resolution_clock::now();
+                    doOp(&ops[i]);
+                    latencies[thread_id].record(duration_cast<nanoseconds>(high_resolution_clock::now() - start).count());
+                } else {
+                    doOp(&ops[i]);
+                }
+                n++;
             }
+            measured[thread_id] = n;
+            attempts[thread_id] = _my_thread.txCount - txBefore;
+            aborts[thread_id] = _my_thread.numAborts - abortsBefore;
         }));
     }
+    cout << "Starting benchmark" << endl;
+    ready.arriveAndWait();
+    auto t1 = high_resolution_clock::now();
+    if (opts.warmup > 0) {
+        this_thread::sleep_for(duration<double>(opts.warmup));
+        t1 = high_resolution_clock::now();
+        phase = MEASURE;
+    }
+    auto t2 = t1;
+    if (opts.duration > 0) {
+        this_thread::sleep_for(duration<double>(opts.duration));
+        t2 = high_resolution_clock::now();
+        phase = STOP;
+    }
     // Barrier
     for_each(workers.begin(), workers.end(), [](thread& t) {
         t.join();
     });
-    auto t2 = high_resolution_clock::now();
-    /* Getting number of milliseconds as a double. */
-    duration<double, std::milli> ms_double = t2 - t1;
-    duration<double> s_double = t2 - t1;
-    cout << "Threads: " << numThreads << endl;
-    cout << "\t" << ms_double.count() << "ms\n";
-    cout << "\t" << (totalOps / s_double.count()) / 1000.0 << " 1000x ops per second\n";
-    outfile << (totalOps / s_double.count()) / 1000.0 << endl;
+    if (opts.duration == 0)
+        t2 = high_resolution_clock::now();
+
+    LatencyHistogram latency;
+    int64_t done = 0, begun = 0, aborted = 0;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        latency.merge(latencies[thread_id]);
+        done += measured[thread_id];
+        begun += attempts[thread_id];
+        aborted += aborts[thread_id];
+    }
+    report(done, t2 - t1, numThreads, latency, begun, aborted);
+}
+
+/**
+ * @brief Benchmarking for HashMap
+ * 
+ * @param w Workload to run, see Workload.hpp
+ * @param opts Warm-up, duration and latency settings
+ * @param earlyRelease Release the chain walked by gets, see HashMap::setEarlyRelease
+ */
+template <typename P>
+void hashbenchmark(const Workload& w, int numThreads, const RunOptions& opts, bool earlyRelease){
+    HashMap m(max<int>(1, (w.keyMax - w.keyMin) * 0.75));
+    m.setEarlyRelease(earlyRelease);
+    txEnterExclusive();
+    for(int64_t key: prepopulateKeys(w)){
+        TxBeginP(P);
+        m.put(key, 0);
+        TxEndP(P);
+    }
+    txLeaveExclusive();
+    runOps(w, numThreads, opts, [&m](const Operation* op) {
+        if(op->op_type == PUT){
+            TxBeginP(P, "hash put");
+            m.put(op->key, 0);
+            TxEndP(P);
+        } else if(op->op_type == DELETE){
+            TxBeginP(P, "hash remove");
+            m.remove(op->key);
+            TxEndP(P);
+        } else if(op->op_type == GET){
+            TxBeginP(P, "hash get");
+            int64_t res;
+            m.get(op->key, res);
+            TxEndP(P);
+        }
+    });
 }
 
 /**
- * @brief Benchmarking for RB tree
+ * @brief Benchmarking for ordered sets (RBTree, SkipList, BPlusTree)
  * 
- * @param totalOps Total operations to benchmark
- * @param keyMin Min value in key range
- * @param keyMax Max value in key range
- * @param puts Proportion of puts
- * @param deletes Proportion of deletes
- * @param gets Proportion of gets
+ * @param w Workload to run, see Workload.hpp
+ * @param opts Warm-up, duration and latency settings
  */
-void benchmark(int totalOps, int numThreads, int keyMin, int keyMax, double puts, double deletes, double gets){
-    RBTree rb;
-    vector<Operation> ops;
-    for(int i = 0; i < totalOps; i++){
-        int key = (rand() % (keyMax - keyMin)) + keyMin;
-        double type = rand() / double(RAND_MAX);
-        if(type < puts){
-            ops.push_back(Operation{PUT, key});
-            // rb.insert(key);
-        } else if(type < puts + deletes){
-            ops.push_back(Operation{DELETE, key});
-            // rb.deleteKey(key);
-        } else{
-            ops.push_back(Operation{GET, key});
-            // rb.contains(key);
+template <typename P, typename OrderedSet>
+void benchmark(const Workload& w, int numThreads, const RunOptions& opts){
+    OrderedSet rb;
+    txEnterExclusive();
+    for(int64_t key: prepopulateKeys(w)){
+        TxBeginP(P);
+        rb.insert(key);
+        TxEndP(P);
+    }
+    txLeaveExclusive();
+    runOps(w, numThreads, opts, [&rb](const Operation* op) {
+        if(op->op_type == PUT){
+            TxBeginP(P, "set insert");
+            rb.insert(op->key);
+            TxEndP(P);
+        } else if(op->op_type == DELETE){
+            TxBeginP(P, "set delete");
+            rb.deleteKey(op->key);
+            TxEndP(P);
+        } else if(op->op_type == GET){
+            TxBeginReadOnlyP(P, "set get");
+            rb.get(op->key);
+            TxEndP(P);
         }
+    });
+}
+
+/**
+ * @brief Benchmarking for the hash map baselines (StripedHashMap,
+ * LockFreeHashMap), same workload as hashbenchmark without transactions
+ */
+template <typename Map>
+void hashbaseline(const Workload& w, int numThreads, const RunOptions& opts){
+    Map m(max<int>(1, (w.keyMax - w.keyMin) * 0.75));
+    for(int64_t key: prepopulateKeys(w)){
+        m.put(key, 0);
     }
+    runOps(w, numThreads, opts, [&m](const Operation* op) {
+        if(op->op_type == PUT){
+            m.put(op->key, 0);
+        } else if(op->op_type == DELETE){
+            m.remove(op->key);
+        } else if(op->op_type == GET){
+            int64_t res;
+            m.get(op->key, res);
+        }
+    });
+}
 
-    assert(ops.size() == (size_t) totalOps);
+/**
+ * @brief Benchmarking for the ordered set baselines (RWLockTree,
+ * LockFreeSkipList), same workload as benchmark without transactions
+ */
+template <typename OrderedSet>
+void orderedbaseline(const Workload& w, int numThreads, const RunOptions& opts){
+    OrderedSet s;
+    for(int64_t key: prepopulateKeys(w)){
+        s.insert(key);
+    }
+    runOps(w, numThreads, opts, [&s](const Operation* op) {
+        if(op->op_type == PUT){
+            s.insert(op->key);
+        } else if(op->op_type == DELETE){
+            s.deleteKey(op->key);
+        } else if(op->op_type == GET){
+            s.get(op->key);
+        }
+    });
+}
 
-    // Shuffle operations
-    auto rng = default_random_engine {};
-    shuffle(begin(ops), end(ops), rng);
-    cout << "Starting benchmark" << endl;
-    auto t1 = high_resolution_clock::now();
+/**
+ * @brief Producer/consumer benchmarking for Deque used as a FIFO queue
+ * 
+ * @param totalOps Total operations to benchmark, half pushes and half pops
+ * @param opts Only the CPUs to pin to are used, the run is a fixed number of items
+ * @param batchSize Items pushed or popped per transaction
+ */
+template <typename P>
+void queuebenchmark(int totalOps, int numThreads, const RunOptions& opts, int batchSize){
+    Deque q;
+    int numItems = totalOps / 2;
+    // Even threads produce and odd threads consume, a single thread does both
+    int numProducers = max(1, (numThreads + 1) / 2);
+    atomic<int> consumed{0};
+    atomic<int64_t> attempts{0}, aborts{0};
+    SpinBarrier ready(numThreads + 1);
     vector<thread> workers;
     // Spawn threads
     for (int thread_id = 0; thread_id < numThreads; thread_id++) {
-        workers.push_back(thread([&rb, thread_id, numThreads, totalOps, ops]() {
-            for (int i = thread_id; i < totalOps; i += numThreads) {
-                // cout << "worker " << thread_id << " doing op "  << i << "\n";
-                Operation op = ops[i];
-                if(op.op_type == PUT){
-                    TxBegin();
-                    rb.insert(op.key);
-                    TxEnd();
-                } else if(op.op_type == DELETE){
-                    TxBegin();
-                    rb.deleteKey(op.key);
-                    TxEnd();
-                } else if(op.op_type == GET){
-                    TxBeginReadOnly();
-                    rb.get(op.key);
-                    TxEnd();
+        workers.push_back(thread([&q, &consumed, &attempts, &aborts, &ready, &opts, thread_id, numThreads, numProducers, numItems, batchSize]() {
+            if (!opts.cpus.empty() && !pinThisThread(opts.cpus[thread_id % opts.cpus.size()]))
+                cout << "failed to pin thread " << thread_id << endl;
+            ready.arriveAndWait();
+            int txBefore = _my_thread.txCount;
+            int64_t abortsBefore = _my_thread.numAborts;
+            bool producer = thread_id % 2 == 0;
+            bool consumer = thread_id % 2 == 1 || numThreads == 1;
+            int toProduce = producer ? numItems / numProducers + (thread_id / 2 < numItems % numProducers) : 0;
+            vector<int64_t> batch;
+            vector<int64_t> out;
+            while (toProduce > 0 || (consumer && consumed.load() < numItems)) {
+                if (toProduce > 0) {
+                    int n = min(batchSize, toProduce);
+                    batch.assign(n, thread_id);
+                    TxBeginP(P, "queue push");
+                    q.pushBack(batch);
+                    TxEndP(P);
+                    toProduce -= n;
+                }
+                if (consumer) {
+                    size_t n;
+                    TxBeginP(P, "queue pop");
+                    out.clear();
+                    n = q.popFront(batchSize, out);
+                    TxEndP(P);
+                    consumed += n;
                 }
-
             }
+            attempts += _my_thread.txCount - txBefore;
+            aborts += _my_thread.numAborts - abortsBefore;
         }));
     }
+    cout << "Starting benchmark" << endl;
+    ready.arriveAndWait();
+    auto t1 = high_resolution_clock::now();
     // Barrier
     for_each(workers.begin(), workers.end(), [](thread& t) {
         t.join();
     });
     auto t2 = high_resolution_clock::now();
-    /* Getting number of milliseconds as a double. */
-    duration<double, std::milli> ms_double = t2 - t1;
-    duration<double> s_double = t2 - t1;
-    cout << "Threads: " << numThreads << endl;
-    cout << "\t" << ms_double.count() << "ms\n";
-    cout << "\t" << (totalOps / s_double.count()) / 1000.0 << " 1000x ops per second\n";
-    outfile << (totalOps / s_double.count()) / 1000.0 << endl;
+    report(totalOps, t2 - t1, numThreads, LatencyHistogram(), attempts, aborts);
+}
+
+// RBTree used as a priority queue: popMin takes the leftmost key. Keys are a
+// set here, so pushing a duplicate key is a no-op
+class RBTreePQ {
+    RBTree<> rb;
+
+public:
+    void push(int64_t key) { rb.insert(key); }
+
+    bool popMin(int64_t& key)
+    {
+        RBTree<>::iterator it = rb.begin();
+        if (it == rb.end())
+            return false;
+        key = *it;
+        rb.deleteKey(key);
+        return true;
+    }
+
+    bool peek(int64_t& key)
+    {
+        RBTree<>::iterator it = rb.begin();
+        if (it == rb.end())
+            return false;
+        key = *it;
+        return true;
+    }
+};
+
+/**
+ * @brief Benchmarking for priority queues (PriorityQueue, RBTreePQ)
+ * 
+ * @param q Queue to run on
+ * @param w Workload to run, puts are pushes, deletes popMins and gets peeks.
+ *          Prepopulated keys are pushed from every thread
+ * @param opts Warm-up, duration and latency settings
+ */
+template <typename P, typename PQ>
+void pqbenchmark(PQ& q, const Workload& w, int numThreads, const RunOptions& opts){
+    vector<int64_t> initial = prepopulateKeys(w);
+    // Prepopulate from every thread, so each one's heap starts with a share
+    vector<thread> fillers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        fillers.push_back(thread([&q, &initial, thread_id, numThreads]() {
+            for (size_t i = thread_id; i < initial.size(); i += numThreads) {
+                TxBeginP(P);
+                q.push(initial[i]);
+                TxEndP(P);
+            }
+        }));
+    }
+    for_each(fillers.begin(), fillers.end(), [](thread& t) {
+        t.join();
+    });
+
+    runOps(w, numThreads, opts, [&q](const Operation* op) {
+        if(op->op_type == PUT){
+            TxBeginP(P, "pq push");
+            q.push(op->key);
+            TxEndP(P);
+        } else if(op->op_type == DELETE){
+            TxBeginP(P, "pq pop");
+            int64_t res;
+            q.popMin(res);
+            TxEndP(P);
+        } else if(op->op_type == GET){
+            TxBeginReadOnlyP(P, "pq peek");
+            int64_t res;
+            q.peek(res);
+            TxEndP(P);
+        }
+    });
+}
+
+// int64_t to int64_t maps for the multi-key benchmarks, missing keys read as 0
+class HashStore {
+    HashMap m;
+
+public:
+    HashStore(const Workload& w) : m(max<int>(1, (w.keyMax - w.keyMin) * 0.75)) {}
+
+    int64_t get(int64_t key)
+    {
+        int64_t v = 0;
+        m.get(key, v);
+        return v;
+    }
+
+    void put(int64_t key, int64_t v) { m.put(key, v); }
+};
+
+class RBStore {
+    RBTree<int64_t, int64_t> rb;
+
+public:
+    RBStore(const Workload&) {}
+
+    int64_t get(int64_t key) { return rb.find(key).value_or(0); }
+
+    void put(int64_t key, int64_t v) { rb.insert_or_assign(key, v); }
+};
+
+#define INITIAL_BALANCE 1000
+
+/**
+ * @brief Benchmarking for transactions over k keys of a Store (HashStore, RBStore)
+ * 
+ * Every key of the range starts out with INITIAL_BALANCE. kind is one of
+ *   bank: move k - 1 from the first account to the other k - 1, then check
+ *         that the total is unchanged
+ *   snapshot: gets read k keys in one read only transaction, puts and
+ *             deletes move 1 between two keys
+ *   rmw: add 1 to each of k keys
+ * Keys follow the workload's distribution, a key may repeat within a
+ * transaction. Throughput counts transactions.
+ * 
+ * @param w Workload to run, see Workload.hpp
+ * @param opts Warm-up, duration and latency settings
+ * @param k Keys per transaction
+ * @return false if the bank total was not conserved
+ */
+template <typename P, typename Store>
+bool multikeybenchmark(const string& kind, const Workload& w, int numThreads, const RunOptions& opts, int k){
+    Store store(w);
+    txEnterExclusive();
+    for(int64_t key = w.keyMin; key < w.keyMax; key++){
+        TxBeginP(P);
+        store.put(key, INITIAL_BALANCE);
+        TxEndP(P);
+    }
+    txLeaveExclusive();
+    if(kind == "bank"){
+        runOps(w, numThreads, opts, [&store, k](const Operation* op) {
+            TxBeginP(P, "bank transfer");
+            store.put(op[0].key, store.get(op[0].key) - (k - 1));
+            for(int j = 1; j < k; j++)
+                store.put(op[j].key, store.get(op[j].key) + 1);
+            TxEndP(P);
+        }, k);
+    } else if(kind == "snapshot"){
+        runOps(w, numThreads, opts, [&store, k](const Operation* op) {
+            if(op->op_type == GET){
+                TxBeginReadOnlyP(P, "snapshot read");
+                int64_t sum = 0;
+                for(int j = 0; j < k; j++)
+                    sum += store.get(op[j].key);
+                TxEndP(P);
+                (void) sum;
+            } else {
+                TxBeginP(P, "snapshot transfer");
+                store.put(op[0].key, store.get(op[0].key) - 1);
+                store.put(op[1 % k].key, store.get(op[1 % k].key) + 1);
+                TxEndP(P);
+            }
+        }, k);
+    } else {
+        runOps(w, numThreads, opts, [&store, k](const Operation* op) {
+            TxBeginP(P, "rmw");
+            for(int j = 0; j < k; j++)
+                store.put(op[j].key, store.get(op[j].key) + 1);
+            TxEndP(P);
+        }, k);
+    }
+
+    if(kind != "bank")
+        return true;
+    int64_t total = 0;
+    for(int64_t key = w.keyMin; key < w.keyMax; key++)
+        total += store.get(key);
+    if(total != (w.keyMax - w.keyMin) * INITIAL_BALANCE){
+        cout << "bank total not conserved: " << total << " expected " << (w.keyMax - w.keyMin) * INITIAL_BALANCE << endl;
+        return false;
+    }
+    cout << "\tbank total conserved" << endl;
+    return true;
+}
+
+// STM variant of the run and the build flags behind the default one
+string stmConfigJson(const string& variant){
+    ostringstream out;
+    out << "{\"variant\": " << jsonString(variant) << ", \"use_stm\": ";
+#ifdef USE_STM
+    out << "true";
+#else
+    out << "false";
+#endif
+    out << ", \"optimistic_read_only\": ";
+#ifdef OPTIMISTIC_READ_ONLY
+    out << "true";
+#else
+    out << "false";
+#endif
+    out << ", \"no_ro_tx\": ";
+#ifdef NO_RO_TX
+    out << "true";
+#else
+    out << "false";
+#endif
+    out << ", \"backoff\": ";
+#ifdef USE_BACKOFF
+    out << "true";
+#else
+    out << "false";
+#endif
+    out << ", \"scheduler\": ";
+#ifdef USE_SCHEDULER
+    out << "true";
+#else
+    out << "false";
+#endif
+    out << ", \"lock_table_pages\": " << jsonString(lockTablePages());
+    out << "}";
+    return out.str();
 }
 
 int main(int argc, char** argv){
@@ -185,9 +585,32 @@ int main(int argc, char** argv){
         ("help", "produce help message")
         ("output-file,o", po::value<string>(), "Output filename. Required.")
         ("num-threads,n", po::value<int>(), "Number of threads. Required.")
-        ("type,t", po::value<string>(), "Type of data structure to run (hash, rb). Required.")
-        ("config,c", po::value<string>(), "Type of workload (read, mixed). Required.")
-        ("key-range,k", po::value<string>(), "Workload key range (small, large). Required.")
+        ("type,t", po::value<string>(), "Type of data structure or multi-key workload to run (hash, rb, skip, bptree, queue, pq, pq-relaxed, rb-pq, bank, snapshot, rmw), or a baseline without the STM (hash-striped, hash-lockfree, rb-rwlock, skip-lockfree). Required.")
+        ("config,c", po::value<string>()->default_value("mixed"), "Preset op mix (read, mixed), overridden by --mix")
+        ("key-range,k", po::value<string>()->default_value("large"), "Preset key range (small, large), overridden by --key-min/--key-max")
+        ("key-min", po::value<int64_t>(), "Smallest key")
+        ("key-max", po::value<int64_t>(), "One past the largest key")
+        ("dist,d", po::value<string>()->default_value("uniform"), "Key distribution (uniform, zipf, hotspot, sequential)")
+        ("skew", po::value<double>()->default_value(0.99), "Zipf exponent in [0, 1)")
+        ("hot-fraction", po::value<double>()->default_value(0.2), "Hotspot: fraction of the keys that are hot")
+        ("hot-prob", po::value<double>()->default_value(0.8), "Hotspot: fraction of the ops on hot keys")
+        ("mix,m", po::value<string>(), "Op mix as puts,deletes,gets weights, e.g. 30,30,40")
+        ("ops", po::value<int64_t>()->default_value(3000000), "Number of operations")
+        ("prepopulate,p", po::value<double>(), "Fraction of the key range inserted before timing (default 0, 1 for priority queues)")
+        ("seed", po::value<uint64_t>()->default_value(0), "Seed of the operation stream")
+        ("batch-size,b", po::value<int>()->default_value(1), "Items per transaction for queue producers and consumers")
+        ("tx-keys,K", po::value<int>()->default_value(4), "Keys per transaction of bank, snapshot and rmw")
+        ("store", po::value<string>()->default_value("hash"), "Map that bank, snapshot and rmw run on (hash, rb)")
+        ("early-release", "Release the read set of hash lookups as they walk a chain")
+        ("warmup,w", po::value<double>()->default_value(0), "Seconds of untimed ops before measuring")
+        ("duration", po::value<double>()->default_value(0), "Measure for this many seconds instead of running every op once")
+        ("latency,l", "Record per op latency and print percentiles")
+        ("pin", po::value<string>(), "Pin threads to CPUs: compact, scatter or a CPU list such as 0,2,4-7")
+        ("stm", po::value<string>()->default_value("default"), "STM variant (default from the build flags, tl2, optimistic-ro, no-ro, backoff, sched, global-lock)")
+        ("sites", "Print the transaction profile and policy of every call site after the run")
+        ("trials", po::value<int>()->default_value(1), "Times to run the benchmark, each on a fresh data structure")
+        ("json", po::value<string>(), "Write a JSON record of the configuration and every trial to this file")
+        ("compare", po::value<string>(), "Compare with a baseline JSON record, exit with 2 on a significant regression")
     ;
 
     po::variables_map vm;
@@ -199,47 +622,184 @@ int main(int argc, char** argv){
         return 1;
     }
 
-    // Num samples
-    int N = 3000000; 
-    int keyMin = -1;
-    int keyMax = -1;
-    double puts = -1;
-    double deletes = -1;
-    double gets = -1;
+    Workload w;
+    w.numOps = vm["ops"].as<int64_t>();
+    w.seed = vm["seed"].as<uint64_t>();
 
     int numThreads = vm["num-threads"].as<int>();
 
     if(vm["key-range"].as<string>() == "small"){
-        keyMin = 100;
-        keyMax = 200;
+        w.keyMin = 100;
+        w.keyMax = 200;
     } else if(vm["key-range"].as<string>() == "large"){
-        keyMin = 10000;
-        keyMax = 20000;
+        w.keyMin = 10000;
+        w.keyMax = 20000;
     } else {
         cout << "unsupported key range" << endl;
     }
+    if(vm.count("key-min"))
+        w.keyMin = vm["key-min"].as<int64_t>();
+    if(vm.count("key-max"))
+        w.keyMax = vm["key-max"].as<int64_t>();
+    if(w.keyMax <= w.keyMin){
+        cout << "key-max must be larger than key-min" << endl;
+        return 1;
+    }
 
     if(vm["config"].as<string>() == "read"){
         // Read heavy
-        puts = 0.05;
-        deletes = 0.05;
-        gets = 0.9;
+        w.puts = 0.05;
+        w.deletes = 0.05;
+        w.gets = 0.9;
     } else if(vm["config"].as<string>() == "mixed"){
-        puts = 0.3;
-        deletes = 0.3;
-        gets = 0.4;
+        w.puts = 0.3;
+        w.deletes = 0.3;
+        w.gets = 0.4;
     } else {
         cout << "unsupported config" << endl;
     }
+    if(vm.count("mix") && !parseMix(vm["mix"].as<string>(), w)){
+        cout << "unsupported mix, expected puts,deletes,gets" << endl;
+        return 1;
+    }
+
+    if(!parseDistribution(vm["dist"].as<string>(), w.dist)){
+        cout << "unsupported key distribution" << endl;
+        return 1;
+    }
+    w.skew = vm["skew"].as<double>();
+    w.hotFraction = vm["hot-fraction"].as<double>();
+    w.hotProb = vm["hot-prob"].as<double>();
+    if(w.dist == ZIPF && (w.skew < 0 || w.skew >= 1)){
+        cout << "zipf skew must be in [0, 1)" << endl;
+        return 1;
+    }
+
+    RunOptions opts;
+    opts.warmup = vm["warmup"].as<double>();
+    opts.duration = vm["duration"].as<double>();
+    opts.latency = vm.count("latency") > 0;
+    if(vm.count("pin") && !cpuOrder(vm["pin"].as<string>(), opts.cpus)){
+        cout << "unsupported pin policy or CPU list" << endl;
+        return 1;
+    }
+
+    string type = vm["type"].as<string>();
+    bool isPQ = type == "pq" || type == "pq-relaxed" || type == "rb-pq";
+    // priority queues used to always start full, keep that as their default
+    w.prepopulate = vm.count("prepopulate") ? vm["prepopulate"].as<double>() : (isPQ ? 1 : 0);
 
     if(vm.count("output-file"))
         outfile.open(vm["output-file"].as<string>(), std::ios_base::app); // append instead of overwrite
 
-    if(vm["type"].as<string>() == "hash"){
-        hashbenchmark(N, numThreads, keyMin, keyMax, puts, deletes, gets);
-    } else if(vm["type"].as<string>() == "rb"){
-        benchmark(N, numThreads, keyMin, keyMax, puts, deletes, gets);
-    } else {
+    bool multikey = type == "bank" || type == "snapshot" || type == "rmw";
+    int k = vm["tx-keys"].as<int>();
+    string store = vm["store"].as<string>();
+    if(multikey && (k < 1 || (type == "bank" && k < 2))){
+        cout << "tx-keys must be at least 1, and at least 2 for bank" << endl;
+        return 1;
+    }
+    if(multikey && store != "hash" && store != "rb"){
+        cout << "unsupported store" << endl;
+        return 1;
+    }
+
+    // one trial on a fresh data structure with STM variant P, false if it
+    // failed its check
+    auto runTrial = [&](auto policy) {
+        using P = decltype(policy);
+        if(type == "hash"){
+            hashbenchmark<P>(w, numThreads, opts, vm.count("early-release") > 0);
+        } else if(type == "rb"){
+            benchmark<P, RBTree<>>(w, numThreads, opts);
+        } else if(type == "skip"){
+            benchmark<P, SkipList>(w, numThreads, opts);
+        } else if(type == "bptree"){
+            benchmark<P, BPlusTree>(w, numThreads, opts);
+        } else if(type == "hash-striped"){
+            hashbaseline<StripedHashMap>(w, numThreads, opts);
+        } else if(type == "hash-lockfree"){
+            hashbaseline<LockFreeHashMap>(w, numThreads, opts);
+        } else if(type == "rb-rwlock"){
+            orderedbaseline<RWLockTree>(w, numThreads, opts);
+        } else if(type == "skip-lockfree"){
+            orderedbaseline<LockFreeSkipList>(w, numThreads, opts);
+        } else if(type == "queue"){
+            queuebenchmark<P>(w.numOps, numThreads, opts, vm["batch-size"].as<int>());
+        } else if(type == "pq"){
+            // one heap per thread, exact popMin
+            PriorityQueue q(numThreads);
+            pqbenchmark<P>(q, w, numThreads, opts);
+        } else if(type == "pq-relaxed"){
+            PriorityQueue q(2 * numThreads, true);
+            pqbenchmark<P>(q, w, numThreads, opts);
+        } else if(type == "rb-pq"){
+            RBTreePQ q;
+            pqbenchmark<P>(q, w, numThreads, opts);
+        } else if(store == "hash"){
+            return multikeybenchmark<P, HashStore>(type, w, numThreads, opts, k);
+        } else {
+            return multikeybenchmark<P, RBStore>(type, w, numThreads, opts, k);
+        }
+        return true;
+    };
+
+    bool baseline = type == "hash-striped" || type == "hash-lockfree" || type == "rb-rwlock" || type == "skip-lockfree";
+    if(!isPQ && !multikey && !baseline && type != "hash" && type != "rb" && type != "skip" && type != "bptree" && type != "queue"){
         cout << "unsupported data structure type" << endl;
+        return 1;
+    }
+    string stm = vm["stm"].as<string>();
+    for(int trial = 0; trial < vm["trials"].as<int>(); trial++){
+        bool ok;
+        if(stm == "default"){
+            ok = runTrial(DefaultStmPolicy());
+        } else if(stm == Tl2Policy::name){
+            ok = runTrial(Tl2Policy());
+        } else if(stm == OptimisticReadOnlyPolicy::name){
+            ok = runTrial(OptimisticReadOnlyPolicy());
+        } else if(stm == NoReadOnlyPolicy::name){
+            ok = runTrial(NoReadOnlyPolicy());
+        } else if(stm == BackoffPolicy::name){
+            ok = runTrial(BackoffPolicy());
+        } else if(stm == SchedulerPolicy::name){
+            ok = runTrial(SchedulerPolicy());
+        } else if(stm == GlobalLockPolicy::name){
+            ok = runTrial(GlobalLockPolicy());
+        } else {
+            cout << "unsupported STM variant" << endl;
+            return 1;
+        }
+        if(!ok)
+            return 1;
+    }
+
+    if(vm.count("sites"))
+        txDumpSites(cout);
+
+    if(vm.count("json")){
+        char hostname[256] = "";
+        gethostname(hostname, sizeof(hostname) - 1);
+        ofstream json(vm["json"].as<string>());
+        json << "{\"type\": " << jsonString(type) << ", \"threads\": " << numThreads;
+        json << ", \"workload\": {\"ops\": " << w.numOps << ", \"key_min\": " << w.keyMin << ", \"key_max\": " << w.keyMax
+             << ", \"dist\": " << jsonString(vm["dist"].as<string>()) << ", \"skew\": " << w.skew
+             << ", \"hot_fraction\": " << w.hotFraction << ", \"hot_prob\": " << w.hotProb
+             << ", \"puts\": " << w.puts << ", \"deletes\": " << w.deletes << ", \"gets\": " << w.gets
+             << ", \"prepopulate\": " << w.prepopulate << ", \"seed\": " << w.seed
+             << ", \"tx_keys\": " << k << ", \"store\": " << jsonString(store)
+             << ", \"batch_size\": " << vm["batch-size"].as<int>()
+             << ", \"early_release\": " << (vm.count("early-release") ? "true" : "false") << "}";
+        json << ", \"run\": {\"warmup\": " << opts.warmup << ", \"duration\": " << opts.duration
+             << ", \"latency\": " << (opts.latency ? "true" : "false")
+             << ", \"pin\": " << jsonString(vm.count("pin") ? vm["pin"].as<string>() : "") << "}";
+        json << ", \"stm\": " << stmConfigJson(stm);
+        json << ", \"machine\": {\"hostname\": " << jsonString(hostname)
+             << ", \"hardware_threads\": " << thread::hardware_concurrency()
+             << ", \"compiler\": " << jsonString(__VERSION__) << "}";
+        json << ", " << trialsJson(trialResults) << "}" << endl;
     }
-}
\ No newline at end of file
+
+    if(vm.count("compare") && !compareWithBaseline(vm["compare"].as<string>(), trialResults, cout))
+        return 2;
+}
@@ -112,7 +112,7 @@ void hashbenchmark(int totalOps, int numThreads, int keyMin, int keyMax, double
  * @param gets Proportion of gets
  */
 void benchmark(int totalOps, int numThreads, int keyMin, int keyMax, double puts, double deletes, double gets){
-    RBTree rb;
+    RBTree<> rb;
     vector<Operation> ops;
     for(int i = 0; i < totalOps; i++){
         int key = (rand() % (keyMax - keyMin)) + keyMin;
@@ -0,0 +1,118 @@
+#ifndef AFFINITY_HPP
+#define AFFINITY_HPP
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+// Pinning benchmark threads to CPUs (Linux only, elsewhere nothing is pinned)
+using namespace std;
+
+// CPUs this process may run on, in id order
+inline vector<int> allowedCpus()
+{
+    vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        }
+    }
+#endif
+    return cpus;
+}
+
+// Parses a list like "0,2,4-7", returns false if malformed
+inline bool parseCpuList(const string& list, vector<int>& cpus)
+{
+    cpus.clear();
+    istringstream in(list);
+    string part;
+    while (getline(in, part, ',')) {
+        int lo, hi;
+        char dash;
+        istringstream range(part);
+        if (!(range >> lo))
+            return false;
+        hi = lo;
+        if (range >> dash && (dash != '-' || !(range >> hi)))
+            return false;
+        if (lo < 0 || hi < lo)
+            return false;
+        for (int cpu = lo; cpu <= hi; cpu++)
+            cpus.push_back(cpu);
+    }
+    return !cpus.empty();
+}
+
+inline int readTopology(int cpu, const string& name)
+{
+    ifstream in("/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/" + name);
+    int v = 0;
+    in >> v;
+    return v;
+}
+
+// Order in which threads take the allowed CPUs:
+//   compact: SMT siblings of a core first, then the next core, then the next socket
+//   scatter: one CPU per socket in turn, and every core once before any SMT sibling
+//   otherwise a CPU list, see parseCpuList
+// Returns false if policy is none of these
+inline bool cpuOrder(const string& policy, vector<int>& cpus)
+{
+    if (policy != "compact" && policy != "scatter")
+        return parseCpuList(policy, cpus);
+
+    // (socket, core, cpu) of every allowed cpu
+    vector<tuple<int, int, int>> topo;
+    for (int cpu : allowedCpus())
+        topo.emplace_back(readTopology(cpu, "physical_package_id"), readTopology(cpu, "core_id"), cpu);
+    sort(topo.begin(), topo.end());
+    cpus.clear();
+    if (policy == "compact") {
+        for (auto& t : topo)
+            cpus.push_back(get<2>(t));
+        return !cpus.empty();
+    }
+
+    // rank of each cpu among its core's siblings, and of its core in its socket
+    vector<tuple<int, int, int, int>> order;
+    map<pair<int, int>, int> siblings;
+    map<int, int> cores;
+    int lastSocket = -1, lastCore = -1;
+    for (auto& t : topo) {
+        int socket = get<0>(t), core = get<1>(t);
+        if (socket != lastSocket || core != lastCore)
+            cores[socket]++;
+        lastSocket = socket;
+        lastCore = core;
+        order.emplace_back(siblings[{ socket, core }]++, cores[socket], socket, get<2>(t));
+    }
+    sort(order.begin(), order.end());
+    for (auto& t : order)
+        cpus.push_back(get<3>(t));
+    return !cpus.empty();
+}
+
+// Pins the calling thread to cpu, returns false if that failed
+inline bool pinThisThread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,449 @@
+#ifndef BPLUS_TREE_HPP
+#define BPLUS_TREE_HPP
+#include <iostream>
+#include <vector>
+#include <iterator>
+#include "stm.hpp"
+#include "TxCounter.hpp"
+
+// B+ tree of int64_t keys, based on https://en.wikipedia.org/wiki/B%2B_tree
+using namespace std;
+
+// Every node is 4 cache lines, allocated on a cache line boundary
+#define BP_NODE_BYTES (4 * CACHE_LINE_SIZE)
+#define BP_LEAF_KEYS 29 // count, leaf, next and 29 keys fill 256 bytes
+#define BP_INNER_KEYS 14 // count, leaf, 14 keys and 15 children fit in 256 bytes
+#define BP_MAX_DEPTH 32
+#define LOAD_BP(addr) ((BPNode*) LOAD(addr))
+
+class BPNode {
+public:
+    int64_t count; // number of keys
+    int64_t leaf;
+
+    BPNode(bool leaf) : count(0), leaf(leaf) {}
+};
+
+// Keys sorted ascending, linked left to right for scans
+class alignas(CACHE_LINE_SIZE) BPLeaf : public BPNode {
+public:
+    BPLeaf* next;
+    int64_t keys[BP_LEAF_KEYS];
+
+    BPLeaf() : BPNode(true), next(NULL) {}
+};
+
+// children[i] holds keys < keys[i], children[i + 1] keys >= keys[i]
+class alignas(CACHE_LINE_SIZE) BPInner : public BPNode {
+public:
+    int64_t keys[BP_INNER_KEYS];
+    BPNode* children[BP_INNER_KEYS + 1];
+
+    BPInner() : BPNode(false) {}
+};
+
+static_assert(sizeof(BPLeaf) == BP_NODE_BYTES, "leaf must fill its cache lines");
+static_assert(sizeof(BPInner) == BP_NODE_BYTES, "inner node must fill its cache lines");
+
+// Ordered set with the same surface as RBTree. A lookup does a branch free
+// binary search in each node, so it reads about log2(keys) + 2 words per level
+// and the tree is only log_15(n) levels deep. Nodes have no parent pointers,
+// updates remember their path instead, so a split or merge only writes the
+// nodes on the path and one sibling.
+class BPlusTree {
+    BPNode* root;
+    TxCounter count;
+
+    // position of the first of the n keys that is >= key (or > key when upper)
+    // Every probe is an instrumented load, so this is a binary search without
+    // branches on the keys rather than a vector compare over the raw array.
+    static int searchKeys(int64_t* keys, int n, int64_t key, bool upper)
+    {
+        int64_t* base = keys;
+        while (n > 1) {
+            int half = n / 2;
+            int64_t probe = LOAD(base[half - 1]);
+            base = (probe < key || (upper && probe == key)) ? base + half : base;
+            n -= half;
+        }
+        if (n == 1) {
+            int64_t probe = LOAD(base[0]);
+            base += (probe < key || (upper && probe == key));
+        }
+        return base - keys;
+    }
+
+    static BPLeaf* newLeaf()
+    {
+        void* mem = MALLOC_ALIGNED(CACHE_LINE_SIZE, sizeof(BPLeaf));
+        return new (mem) BPLeaf();
+    }
+
+    static BPInner* newInner()
+    {
+        void* mem = MALLOC_ALIGNED(CACHE_LINE_SIZE, sizeof(BPInner));
+        return new (mem) BPInner();
+    }
+
+    // walks from the root to the leaf that would hold key, remembering the
+    // inner nodes and which child was taken. Returns the leaf
+    BPLeaf* findLeaf(int64_t key, BPInner** path, int* childIdx, int& depth)
+    {
+        depth = 0;
+        BPNode* n = LOAD_BP(root);
+        while (!LOAD(n->leaf)) {
+            BPInner* inner = (BPInner*) n;
+            int i = searchKeys(inner->keys, LOAD(inner->count), key, true);
+            path[depth] = inner;
+            childIdx[depth] = i;
+            depth++;
+            n = LOAD_BP(inner->children[i]);
+        }
+        return (BPLeaf*) n;
+    }
+
+    // inserts separator key and its right child at position i of inner,
+    // splitting it when full. Returns the new right half, or NULL if no split
+    // was needed, in which case sepOut is untouched
+    BPInner* insertInner(BPInner* inner, int i, int64_t key, BPNode* child, int64_t& sepOut)
+    {
+        int n = LOAD(inner->count);
+        if (n < BP_INNER_KEYS) {
+            for (int j = n; j > i; j--) {
+                STORE(inner->keys[j], LOAD(inner->keys[j - 1]));
+                STORE(inner->children[j + 1], LOAD_BP(inner->children[j]));
+            }
+            STORE(inner->keys[i], key);
+            STORE(inner->children[i + 1], child);
+            STORE(inner->count, n + 1);
+            return NULL;
+        }
+
+        // full, lay out all keys and children then cut in the middle
+        int64_t keys[BP_INNER_KEYS + 1];
+        BPNode* children[BP_INNER_KEYS + 2];
+        children[0] = LOAD_BP(inner->children[0]);
+        for (int j = 0, k = 0; j < BP_INNER_KEYS + 1; j++) {
+            if (j == i) {
+                keys[j] = key;
+                children[j + 1] = child;
+            } else {
+                keys[j] = LOAD(inner->keys[k]);
+                children[j + 1] = LOAD_BP(inner->children[k + 1]);
+                k++;
+            }
+        }
+        int leftCount = (BP_INNER_KEYS + 1) / 2;
+        BPInner* right = newInner();
+        // right is still private, write it directly
+        right->count = BP_INNER_KEYS - leftCount;
+        for (int j = 0; j < right->count; j++) {
+            right->keys[j] = keys[leftCount + 1 + j];
+            right->children[j] = children[leftCount + 1 + j];
+        }
+        right->children[right->count] = children[BP_INNER_KEYS + 1];
+        // only rewrite the left half from the insertion point on
+        for (int j = i; j < leftCount; j++) {
+            STORE(inner->keys[j], keys[j]);
+            STORE(inner->children[j + 1], children[j + 1]);
+        }
+        STORE(inner->count, leftCount);
+        sepOut = keys[leftCount];
+        return right;
+    }
+
+    // removes key i and child i + 1 from inner
+    void eraseInner(BPInner* inner, int i)
+    {
+        int n = LOAD(inner->count);
+        for (int j = i; j < n - 1; j++) {
+            STORE(inner->keys[j], LOAD(inner->keys[j + 1]));
+            STORE(inner->children[j + 1], LOAD_BP(inner->children[j + 2]));
+        }
+        STORE(inner->count, n - 1);
+    }
+
+    // Merges node with an adjacent sibling under the same parent when both
+    // fit in one node, then removes the separator from the parent and repeats
+    // one level up if the parent became small. No borrowing, so a delete
+    // writes at most the path, one sibling and the freed node.
+    void mergeUp(BPNode* node, BPInner** path, int* childIdx, int depth)
+    {
+        while (depth > 0) {
+            BPInner* parent = path[depth - 1];
+            int i = childIdx[depth - 1];
+            int parentCount = LOAD(parent->count);
+            bool isLeaf = LOAD(node->leaf);
+            int capacity = isLeaf ? BP_LEAF_KEYS : BP_INNER_KEYS;
+            if (LOAD(node->count) >= capacity / 4)
+                return;
+
+            // merge the right one of the pair into the left one
+            int leftIdx = i < parentCount ? i : i - 1;
+            if (leftIdx < 0)
+                return;
+            BPNode* left = LOAD_BP(parent->children[leftIdx]);
+            BPNode* right = LOAD_BP(parent->children[leftIdx + 1]);
+            int leftCount = LOAD(left->count);
+            int rightCount = LOAD(right->count);
+
+            if (isLeaf) {
+                if (leftCount + rightCount > BP_LEAF_KEYS)
+                    return;
+                BPLeaf* l = (BPLeaf*) left;
+                BPLeaf* r = (BPLeaf*) right;
+                for (int j = 0; j < rightCount; j++)
+                    STORE(l->keys[leftCount + j], LOAD(r->keys[j]));
+                STORE(l->count, leftCount + rightCount);
+                STORE(l->next, LOAD(r->next));
+            } else {
+                if (leftCount + 1 + rightCount > BP_INNER_KEYS)
+                    return;
+                BPInner* l = (BPInner*) left;
+                BPInner* r = (BPInner*) right;
+                // the separator comes down between the two halves
+                STORE(l->keys[leftCount], LOAD(parent->keys[leftIdx]));
+                for (int j = 0; j < rightCount; j++) {
+                    STORE(l->keys[leftCount + 1 + j], LOAD(r->keys[j]));
+                    STORE(l->children[leftCount + 1 + j], LOAD_BP(r->children[j]));
+                }
+                STORE(l->children[leftCount + 1 + rightCount], LOAD_BP(r->children[rightCount]));
+                STORE(l->count, leftCount + 1 + rightCount);
+            }
+            eraseInner(parent, leftIdx);
+            FREE(right);
+
+            if (parent == LOAD_BP(root) && LOAD(parent->count) == 0) {
+                // root with a single child, the tree gets shorter
+                STORE(root, left);
+                FREE(parent);
+                return;
+            }
+            node = parent;
+            depth--;
+        }
+    }
+
+    static BPLeaf* firstLeaf(BPNode* n)
+    {
+        while (!LOAD(n->leaf))
+            n = LOAD_BP(((BPInner*) n)->children[0]);
+        return (BPLeaf*) n;
+    }
+
+    int heightHelp(BPNode* n)
+    {
+        if (n->leaf)
+            return 1;
+        return heightHelp(((BPInner*) n)->children[0]) + 1;
+    }
+
+public:
+    // Forward iterator in key order over the linked leaves. Same rules as
+    // RBTree::iterator: must not be used across transactions.
+    class iterator {
+        BPLeaf* leaf;
+        int idx;
+
+        // moves on to the next leaf once idx runs off the end of this one
+        void skipExhausted()
+        {
+            while (leaf != NULL && idx >= LOAD(leaf->count)) {
+                leaf = (BPLeaf*) LOAD(leaf->next);
+                idx = 0;
+            }
+        }
+
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = int64_t;
+        using difference_type = ptrdiff_t;
+        using pointer = const int64_t*;
+        // keys are read through LOAD, so dereferencing yields a copy
+        using reference = int64_t;
+
+        iterator() : leaf(NULL), idx(0) {}
+        iterator(BPLeaf* leaf, int idx)
+            : leaf(leaf)
+            , idx(idx)
+        {
+            skipExhausted();
+        }
+
+        int64_t operator*() const { return LOAD(leaf->keys[idx]); }
+
+        iterator& operator++()
+        {
+            idx++;
+            skipExhausted();
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator old = *this;
+            ++(*this);
+            return old;
+        }
+
+        bool operator==(const iterator& other) const { return leaf == other.leaf && idx == other.idx; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+    };
+
+    BPlusTree() : root(newLeaf()) {}
+
+    // inserts the given value
+    // returns false if the value was already present
+    bool insert(int64_t n)
+    {
+        BPInner* path[BP_MAX_DEPTH];
+        int childIdx[BP_MAX_DEPTH];
+        int depth;
+        BPLeaf* leaf = findLeaf(n, path, childIdx, depth);
+
+        int used = LOAD(leaf->count);
+        int pos = searchKeys(leaf->keys, used, n, false);
+        if (pos < used && LOAD(leaf->keys[pos]) == n)
+            return false;
+        count.increment();
+
+        if (used < BP_LEAF_KEYS) {
+            for (int j = used; j > pos; j--)
+                STORE(leaf->keys[j], LOAD(leaf->keys[j - 1]));
+            STORE(leaf->keys[pos], n);
+            STORE(leaf->count, used + 1);
+            return true;
+        }
+
+        // split the leaf, the right half moves to a new leaf
+        int64_t keys[BP_LEAF_KEYS + 1];
+        for (int j = 0, k = 0; j < BP_LEAF_KEYS + 1; j++)
+            keys[j] = j == pos ? n : LOAD(leaf->keys[k++]);
+        int leftCount = (BP_LEAF_KEYS + 1) / 2;
+        BPLeaf* right = newLeaf();
+        right->count = BP_LEAF_KEYS + 1 - leftCount;
+        for (int j = 0; j < right->count; j++)
+            right->keys[j] = keys[leftCount + j];
+        right->next = (BPLeaf*) LOAD(leaf->next);
+        for (int j = pos; j < leftCount; j++)
+            STORE(leaf->keys[j], keys[j]);
+        STORE(leaf->count, leftCount);
+        STORE(leaf->next, right);
+
+        // push the separator up the path until a node has room
+        int64_t sep = keys[leftCount];
+        BPNode* newChild = right;
+        while (depth > 0) {
+            depth--;
+            int64_t upSep = 0;
+            BPInner* split = insertInner(path[depth], childIdx[depth], sep, newChild, upSep);
+            if (split == NULL)
+                return true;
+            sep = upSep;
+            newChild = split;
+        }
+
+        // the root split, grow a level
+        BPInner* newRoot = newInner();
+        newRoot->count = 1;
+        newRoot->keys[0] = sep;
+        newRoot->children[0] = LOAD_BP(root);
+        newRoot->children[1] = newChild;
+        STORE(root, newRoot);
+        return true;
+    }
+
+    // deletes the given value, returns false if it was not present
+    bool deleteKey(int64_t n)
+    {
+        BPInner* path[BP_MAX_DEPTH];
+        int childIdx[BP_MAX_DEPTH];
+        int depth;
+        BPLeaf* leaf = findLeaf(n, path, childIdx, depth);
+
+        int used = LOAD(leaf->count);
+        int pos = searchKeys(leaf->keys, used, n, false);
+        if (pos == used || LOAD(leaf->keys[pos]) != n)
+            return false;
+
+        for (int j = pos; j < used - 1; j++)
+            STORE(leaf->keys[j], LOAD(leaf->keys[j + 1]));
+        STORE(leaf->count, used - 1);
+        mergeUp(leaf, path, childIdx, depth);
+        count.decrement();
+        return true;
+    }
+
+    bool get(int64_t key)
+    {
+        BPInner* path[BP_MAX_DEPTH];
+        int childIdx[BP_MAX_DEPTH];
+        int depth;
+        BPLeaf* leaf = findLeaf(key, path, childIdx, depth);
+        int used = LOAD(leaf->count);
+        int pos = searchKeys(leaf->keys, used, key, false);
+        return pos < used && LOAD(leaf->keys[pos]) == key;
+    }
+
+    vector<int64_t> inorder()
+    {
+        vector<int64_t> v;
+        for (iterator it = begin(); it != end(); ++it)
+            v.push_back(*it);
+        return v;
+    }
+
+    // Number of keys, O(threads) instead of a full walk
+    size_t size()
+    {
+        return count.get();
+    }
+
+    // Non-transactional estimate of size(), never causes an abort
+    size_t sizeApprox()
+    {
+        return count.approx();
+    }
+
+    iterator begin() { return iterator(firstLeaf(LOAD_BP(root)), 0); }
+
+    iterator end() { return iterator(); }
+
+    // first key >= key
+    iterator lowerBound(int64_t key)
+    {
+        BPInner* path[BP_MAX_DEPTH];
+        int childIdx[BP_MAX_DEPTH];
+        int depth;
+        BPLeaf* leaf = findLeaf(key, path, childIdx, depth);
+        return iterator(leaf, searchKeys(leaf->keys, LOAD(leaf->count), key, false));
+    }
+
+    // calls f(key) on every key in [lo, hi] in ascending order
+    template <typename F>
+    void rangeScan(int64_t lo, int64_t hi, F f)
+    {
+        for (iterator it = lowerBound(lo); it != end(); ++it) {
+            int64_t key = *it;
+            if (key > hi)
+                break;
+            f(key);
+        }
+    }
+
+    // number of keys in [lo, hi]
+    size_t rangeCount(int64_t lo, int64_t hi)
+    {
+        size_t n = 0;
+        rangeScan(lo, hi, [&n](int64_t) { n++; });
+        return n;
+    }
+
+    // levels from the root to the leaves, all leaves are at the same depth
+    int height()
+    {
+        return heightHelp(root);
+    }
+};
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef CO_TX_HPP
+#define CO_TX_HPP
+#include <coroutine>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "stm.hpp"
+
+// Transactions for C++20 coroutines. Many coroutines share one OS thread
+// through a CoScheduler, each with a CoTx of its own. Where a plain
+// transaction aborts on a locked stripe, a CoTx suspends its coroutine and
+// the scheduler runs the others until the stripe is free, then the load or
+// commit is retried with the transaction intact. Only real conflicts (a
+// version past the transaction's snapshot) roll it back. The body of a
+// transaction must use its CoTx, the LOAD/STORE macros and the data
+// structures built on them belong to the thread's own _my_thread
+//
+//     CoTask transfer(CoTx& tx, int64_t& from, int64_t& to)
+//     {
+//         while (true) {
+//             tx.begin();
+//             int64_t a, b;
+//             if (!co_await tx.load(from, a) || !co_await tx.load(to, b))
+//                 continue;
+//             if (!tx.store(from, a - 1) || !tx.store(to, b + 1))
+//                 continue;
+//             if (co_await tx.commit())
+//                 break;
+//         }
+//     }
+using namespace std;
+
+class CoScheduler;
+
+// Top level coroutine, started by CoScheduler::spawn
+class CoTask {
+public:
+    struct promise_type;
+    using Handle = coroutine_handle<promise_type>;
+
+    explicit CoTask(Handle handle) : handle(handle) {}
+    CoTask(CoTask&& other) : handle(other.handle) { other.handle = nullptr; }
+    CoTask(const CoTask&) = delete;
+    ~CoTask()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool done() const { return handle.done(); }
+
+private:
+    friend class CoScheduler;
+    Handle handle;
+};
+
+// Round robin over the suspended coroutines of one thread. Not thread safe,
+// every coroutine of a scheduler runs on the thread that calls run()
+class CoScheduler {
+public:
+    // A suspended coroutine, resumed once poll() returns true
+    struct Waiter {
+        coroutine_handle<> handle;
+
+        virtual bool poll() { return true; }
+    };
+
+    // Takes ownership of task, which starts on the next run()
+    void spawn(CoTask task);
+
+    // Runs every spawned coroutine to completion. When a whole round of
+    // polls finds nothing to resume the thread yields
+    void run();
+
+    void suspend(Waiter* waiter, coroutine_handle<> handle)
+    {
+        waiter->handle = handle;
+        waiting.push_back(waiter);
+        suspensions++;
+    }
+
+    // Lets the scheduler's other coroutines run
+    auto yield()
+    {
+        struct Awaiter : Waiter {
+            CoScheduler& sched;
+
+            Awaiter(CoScheduler& sched) : sched(sched) {}
+            bool await_ready() { return false; }
+            void await_suspend(coroutine_handle<> h) { sched.suspend(this, h); }
+            void await_resume() {}
+        };
+        return Awaiter(*this);
+    }
+
+    int64_t suspensions = 0; // times a coroutine was suspended
+
+private:
+    deque<Waiter*> waiting;
+    vector<CoTask> tasks;
+};
+
+struct CoTask::promise_type {
+    CoScheduler::Waiter start;
+
+    CoTask get_return_object() { return CoTask(Handle::from_promise(*this)); }
+    suspend_always initial_suspend() { return {}; }
+    suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { terminate(); }
+};
+
+inline void CoScheduler::spawn(CoTask task)
+{
+    CoTask::Handle handle = task.handle;
+    tasks.push_back(move(task));
+    waiting.push_back(&handle.promise().start);
+    handle.promise().start.handle = handle;
+}
+
+inline void CoScheduler::run()
+{
+    size_t idle = 0;
+    while (!waiting.empty()) {
+        Waiter* waiter = waiting.front();
+        waiting.pop_front();
+        if (waiter->poll()) {
+            idle = 0;
+            waiter->handle.resume();
+        } else {
+            waiting.push_back(waiter);
+            if (++idle >= waiting.size()) {
+                this_thread::yield();
+                idle = 0;
+            }
+        }
+    }
+    tasks.clear();
+}
+
+// A transaction for one coroutine at a time, with a descriptor of its own
+class CoTx {
+    CoScheduler& sched;
+    TxThread t;
+    bool upgrade = false; // a read only attempt wrote, run the next as read-write
+
+    // Retries op while it is TX_BUSY, suspended in between. Rolls the
+    // transaction back on TX_CONFLICT and resumes with false
+    template <typename Op>
+    struct Awaiter : CoScheduler::Waiter {
+        CoTx& tx;
+        Op op;
+        TxStatus status;
+
+        Awaiter(CoTx& tx, Op op) : tx(tx), op(op) {}
+
+        bool poll() override
+        {
+            status = op();
+            return status != TX_BUSY;
+        }
+
+        bool await_ready() { return poll(); }
+        void await_suspend(coroutine_handle<> h) { tx.sched.suspend(this, h); }
+
+        bool await_resume()
+        {
+            if (status == TX_CONFLICT) {
+                tx.t.txRollback();
+                return false;
+            }
+            return true;
+        }
+    };
+
+    template <typename Op>
+    Awaiter<Op> await(Op op)
+    {
+        return Awaiter<Op>(*this, op);
+    }
+
+public:
+    // A suspended transaction must not hold up a serial one (see TxSite),
+    // or a coroutine beginning on the same thread would wait on it in turn
+    CoTx(CoScheduler& sched) : sched(sched) { t.quiesce = false; }
+
+    void begin(bool readOnly = false)
+    {
+        StmPolicyOps<DefaultStmPolicy>::prepare(t, readOnly && !upgrade);
+        upgrade = false;
+        t.txBegin();
+    }
+
+    // co_await tx.load(var, out) reads var into out, false if the
+    // transaction was rolled back
+    template <typename T>
+    auto load(const T& var, T& out)
+    {
+        static_assert(sizeof(T) == sizeof(intptr_t) && is_trivially_copyable<T>::value, "only word sized values");
+        return await([this, &var, &out]() {
+            intptr_t word;
+            TxStatus status = t.txTryLoad((intptr_t*) &var, word);
+            memcpy(&out, &word, sizeof(T));
+            return status;
+        });
+    }
+
+    // Buffers the write, false if the transaction was rolled back (a read
+    // only one, the next begin runs read-write)
+    template <typename T>
+    bool store(T& var, const T& val)
+    {
+        static_assert(sizeof(T) == sizeof(intptr_t) && is_trivially_copyable<T>::value, "only word sized values");
+        intptr_t word;
+        memcpy(&word, &val, sizeof(T));
+        if (t.txTryStore((intptr_t*) &var, word) == TX_OK)
+            return true;
+        upgrade = true;
+        t.txRollback();
+        return false;
+    }
+
+    // co_await tx.commit(), false if the transaction was rolled back
+    auto commit()
+    {
+        return await([this]() {
+            TxStatus status = t.txTryCommit();
+            if (status == TX_OK)
+                t.inTx = false;
+            return status;
+        });
+    }
+
+    TxThread& descriptor() { return t; }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef DEQUE_HPP
+#define DEQUE_HPP
+#include <iostream>
+#include <vector>
+#include "stm.hpp"
+#include "TxCounter.hpp"
+
+using namespace std;
+
+#define LOAD_DN(addr) ((DequeNode*) LOAD(addr))
+
+class DequeNode {
+public:
+    int64_t val;
+    DequeNode *prev, *next;
+
+    DequeNode(int64_t val) : val(val), prev(NULL), next(NULL) {}
+};
+
+// Doubly linked deque between two sentinels, usable as a FIFO queue through
+// pushBack/popFront. The sentinels live on their own cache lines, so the
+// back only touches tail.prev and the last node's next, and the front only
+// head.next and the second node's prev. Once there are 2 or more items,
+// producers at one end and consumers at the other never share a word.
+// Batch operations link or unlink a whole chain with the same 2 shared writes.
+class Deque {
+    struct alignas(CACHE_LINE_SIZE) Sentinel {
+        DequeNode node;
+        Sentinel() : node(0) {}
+    };
+    Sentinel head;
+    Sentinel tail;
+    TxCounter count;
+
+    static DequeNode* newNode(int64_t val)
+    {
+        void* nodeMem = MALLOC(sizeof(DequeNode));
+        return new (nodeMem) DequeNode(val);
+    }
+
+    // links the private chain first..last between the shared nodes a and b
+    void splice(DequeNode* a, DequeNode* first, DequeNode* last, DequeNode* b)
+    {
+        first->prev = a;
+        last->next = b;
+        STORE(a->next, first);
+        STORE(b->prev, last);
+    }
+
+    // builds a private chain from vals, returns its first node and sets last
+    template <typename It>
+    static DequeNode* chain(It begin, It end, DequeNode*& last)
+    {
+        DequeNode* first = NULL;
+        last = NULL;
+        for (It it = begin; it != end; ++it) {
+            DequeNode* n = newNode(*it);
+            if (last == NULL) {
+                first = n;
+            } else {
+                last->next = n;
+                n->prev = last;
+            }
+            last = n;
+        }
+        return first;
+    }
+
+public:
+    Deque()
+    {
+        head.node.next = &tail.node;
+        tail.node.prev = &head.node;
+    }
+
+    void pushBack(int64_t val)
+    {
+        DequeNode* n = newNode(val);
+        splice(LOAD_DN(tail.node.prev), n, n, &tail.node);
+        count.increment();
+    }
+
+    void pushFront(int64_t val)
+    {
+        DequeNode* n = newNode(val);
+        splice(&head.node, n, n, LOAD_DN(head.node.next));
+        count.increment();
+    }
+
+    // appends vals in order
+    void pushBack(const vector<int64_t>& vals)
+    {
+        if (vals.empty())
+            return;
+        DequeNode* last;
+        DequeNode* first = chain(vals.begin(), vals.end(), last);
+        splice(LOAD_DN(tail.node.prev), first, last, &tail.node);
+        count.add(vals.size());
+    }
+
+    // prepends vals so that vals[0] ends up at the front
+    void pushFront(const vector<int64_t>& vals)
+    {
+        if (vals.empty())
+            return;
+        DequeNode* last;
+        DequeNode* first = chain(vals.begin(), vals.end(), last);
+        splice(&head.node, first, last, LOAD_DN(head.node.next));
+        count.add(vals.size());
+    }
+
+    // removes the front item into val, returns false if empty
+    bool popFront(int64_t& val)
+    {
+        DequeNode* n = LOAD_DN(head.node.next);
+        if (n == &tail.node)
+            return false;
+        val = LOAD(n->val);
+        DequeNode* next = LOAD_DN(n->next);
+        STORE(head.node.next, next);
+        STORE(next->prev, &head.node);
+        FREE(n);
+        count.decrement();
+        return true;
+    }
+
+    bool popBack(int64_t& val)
+    {
+        DequeNode* n = LOAD_DN(tail.node.prev);
+        if (n == &head.node)
+            return false;
+        val = LOAD(n->val);
+        DequeNode* prev = LOAD_DN(n->prev);
+        STORE(tail.node.prev, prev);
+        STORE(prev->next, &tail.node);
+        FREE(n);
+        count.decrement();
+        return true;
+    }
+
+    // removes up to max items from the front, appending them to out in
+    // order. Returns how many were removed. An aborted attempt has already
+    // appended, so clear out after TxBegin()
+    size_t popFront(size_t max, vector<int64_t>& out)
+    {
+        DequeNode* n = LOAD_DN(head.node.next);
+        size_t taken = 0;
+        while (taken < max && n != &tail.node) {
+            out.push_back(LOAD(n->val));
+            DequeNode* next = LOAD_DN(n->next);
+            FREE(n);
+            n = next;
+            taken++;
+        }
+        if (taken > 0) {
+            STORE(head.node.next, n);
+            STORE(n->prev, &head.node);
+            count.add(-(int64_t) taken);
+        }
+        return taken;
+    }
+
+    // removes up to max items from the back, appending them to out starting
+    // with the last item
+    size_t popBack(size_t max, vector<int64_t>& out)
+    {
+        DequeNode* n = LOAD_DN(tail.node.prev);
+        size_t taken = 0;
+        while (taken < max && n != &head.node) {
+            out.push_back(LOAD(n->val));
+            DequeNode* prev = LOAD_DN(n->prev);
+            FREE(n);
+            n = prev;
+            taken++;
+        }
+        if (taken > 0) {
+            STORE(tail.node.prev, n);
+            STORE(n->next, &tail.node);
+            count.add(-(int64_t) taken);
+        }
+        return taken;
+    }
+
+    // front item without removing it, returns false if empty
+    bool peekFront(int64_t& val)
+    {
+        DequeNode* n = LOAD_DN(head.node.next);
+        if (n == &tail.node)
+            return false;
+        val = LOAD(n->val);
+        return true;
+    }
+
+    bool empty()
+    {
+        return LOAD_DN(head.node.next) == &tail.node;
+    }
+
+    // Number of items, O(threads) and free of head/tail conflicts
+    size_t size()
+    {
+        return count.get();
+    }
+
+    // Non-transactional estimate of size(), never causes an abort
+    size_t sizeApprox()
+    {
+        return count.approx();
+    }
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define HASH_TABLE_HPP
 #include <iostream>
 #include "stm.hpp"
+#include "TxCounter.hpp"
 // Hash table implementation adapted from https://aozturk.medium.com/simple-hash-map-hash-table-implementation-in-c-931965904250
 
 #define LOAD_HN(addr) ((HashNode*) LOAD(addr))
@@ -32,6 +33,15 @@ public:
         STORE(next, _next);
     }
 
+    // early release, see HashMap::get
+    void releaseKey() {
+        RELEASE(key);
+    }
+
+    void releaseNext() {
+        RELEASE(next);
+    }
+
 private:
     // key-value pair
     int64_t key;
@@ -64,6 +74,7 @@ public:
 
     bool get(const int64_t &key, int64_t& value) {
         unsigned long hashValue = key % table_size;
+        HashNode* prev = NULL;
         HashNode* entry = (HashNode*) LOAD(table[hashValue]);
 
         while (entry != NULL) {
@@ -71,11 +82,27 @@ public:
                 value = entry->getValue();
                 return true;
             }
-            entry = entry->getNext();
+            HashNode* next = entry->getNext();
+            if (earlyRelease && next != NULL) {
+                // hand over hand, keep only the link to next: an entry that goes
+                // away is freed, and a new key is appended to the NULL link at the end
+                if (prev == NULL)
+                    RELEASE(table[hashValue]);
+                else
+                    prev->releaseNext();
+                entry->releaseKey();
+            }
+            prev = entry;
+            entry = next;
         }
         return false;
     }
 
+    // Opt in to early release of the chain in get, see TxThread::txRelease
+    void setEarlyRelease(bool enable) {
+        earlyRelease = enable;
+    }
+
     void put(const int64_t key, const int64_t value) {
         // unsigned long hashValue = key % table_size;
         // HashNode* prev;
@@ -121,6 +148,7 @@ public:
             } else {
                 prev->setNext(entry);
             }
+            count.increment();
         } else {
             // just update the value
             entry->setValue(value);
@@ -150,13 +178,26 @@ public:
             }
             // delete entry; // TODO tx memory management
             FREE(entry);
+            count.decrement();
         }
     }
 
+    // Number of keys, O(threads) instead of a walk over every bucket
+    size_t size() {
+        return count.get();
+    }
+
+    // Non-transactional estimate of size(), never causes an abort
+    size_t sizeApprox() {
+        return count.approx();
+    }
+
 private:
     // hash table
     HashNode**table;
     int table_size;
+    TxCounter count;
+    bool earlyRelease = false;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// 2^LATENCY_SUB_BITS linear buckets per power of two, so a recorded value
+// is off by at most 1 / 2^LATENCY_SUB_BITS (about 3%)
+#define LATENCY_SUB_BITS 5
+
+// HDR style log-linear histogram of latencies in ns. Values below
+// 2^LATENCY_SUB_BITS get a bucket each, every larger power of two is split
+// into 2^LATENCY_SUB_BITS buckets. Recording is an index computation and an
+// increment, meant to be kept per thread and merged once the run is over.
+class LatencyHistogram {
+    static const int SUB = 1 << LATENCY_SUB_BITS;
+    vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t maxValue;
+
+    static int index(uint64_t v)
+    {
+        if (v < (uint64_t) SUB)
+            return v;
+        int shift = 63 - __builtin_clzll(v) - LATENCY_SUB_BITS;
+        return (shift + 1) * SUB + (int) ((v >> shift) - SUB);
+    }
+
+    // largest value that falls in bucket i
+    static uint64_t highest(int i)
+    {
+        if (i < SUB)
+            return i;
+        int shift = i / SUB - 1;
+        return (((uint64_t) (i % SUB + SUB + 1)) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram()
+        : counts((64 - LATENCY_SUB_BITS + 1) * SUB, 0)
+        , total(0)
+        , maxValue(0)
+    {}
+
+    void record(uint64_t ns)
+    {
+        counts[index(ns)]++;
+        total++;
+        maxValue = max(maxValue, ns);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < counts.size(); i++)
+            counts[i] += other.counts[i];
+        total += other.total;
+        maxValue = max(maxValue, other.maxValue);
+    }
+
+    // smallest recorded latency that at least p percent of the values are <=,
+    // rounded up to the top of its bucket. 0 if nothing was recorded
+    uint64_t percentile(double p) const
+    {
+        uint64_t target = max<uint64_t>(1, (uint64_t) (p / 100.0 * total + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= target)
+                return min(highest(i), maxValue);
+        }
+        return maxValue;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t maxLatency() const { return maxValue; }
+};
+
+#endif
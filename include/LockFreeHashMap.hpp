@@ -0,0 +1,168 @@
+#ifndef LOCK_FREE_HASH_MAP_HPP
+#define LOCK_FREE_HASH_MAP_HPP
+#include <atomic>
+#include <cstdint>
+
+// Baseline for HashMap without the STM, see bench --type hash-lockfree.
+// Every bucket is a lock-free sorted list (Harris, with Michael's unlinking
+// during search): a remove first marks the low bit of the node's next
+// pointer, and whoever walks past a marked node unlinks it with a CAS.
+// Removed nodes are only freed with the map, since a concurrent reader may
+// still be on them, so memory grows with the number of removes. Not for use
+// inside transactions
+using namespace std;
+
+class LockFreeHashMap {
+    struct Node {
+        int64_t key;
+        atomic<int64_t> value;
+        atomic<uintptr_t> next; // low bit set once the node is removed
+        Node* retiredNext;
+
+        Node(int64_t key, int64_t value, uintptr_t next)
+            : key(key)
+            , value(value)
+            , next(next)
+            , retiredNext(NULL)
+        {
+        }
+    };
+
+    static bool marked(uintptr_t p) { return p & 1; }
+    static Node* ptr(uintptr_t p) { return (Node*) (p & ~(uintptr_t) 1); }
+
+    atomic<uintptr_t>* table;
+    int table_size;
+    atomic<Node*> retired; // removed nodes, freed by the destructor
+    atomic<int64_t> count;
+
+    void retire(Node* node)
+    {
+        Node* head = retired.load();
+        do {
+            node->retiredNext = head;
+        } while (!retired.compare_exchange_weak(head, node));
+    }
+
+    // Sets prev to the link that points to cur, the first unmarked node with
+    // a key >= key (or NULL). Unlinks the marked nodes it passes
+    void find(atomic<uintptr_t>* bucket, int64_t key, atomic<uintptr_t>*& prev, Node*& cur)
+    {
+    retry:
+        prev = bucket;
+        cur = ptr(prev->load());
+        while (cur != NULL) {
+            uintptr_t next = cur->next.load();
+            if (prev->load() != (uintptr_t) cur)
+                goto retry;
+            if (marked(next)) {
+                uintptr_t expected = (uintptr_t) cur;
+                if (!prev->compare_exchange_strong(expected, (uintptr_t) ptr(next)))
+                    goto retry;
+            } else {
+                if (cur->key >= key)
+                    return;
+                prev = &cur->next;
+            }
+            cur = ptr(next);
+        }
+    }
+
+public:
+    LockFreeHashMap(int table_size)
+        : table(new atomic<uintptr_t>[table_size]())
+        , table_size(table_size)
+        , retired(NULL)
+        , count(0)
+    {
+    }
+
+    // Not safe while other threads still use the map
+    ~LockFreeHashMap()
+    {
+        for (int i = 0; i < table_size; i++) {
+            Node* entry = ptr(table[i].load());
+            while (entry != NULL) {
+                uintptr_t next = entry->next.load();
+                // a marked node is also on the retired list
+                if (!marked(next))
+                    delete entry;
+                entry = ptr(next);
+            }
+        }
+        Node* node = retired.load();
+        while (node != NULL) {
+            Node* next = node->retiredNext;
+            delete node;
+            node = next;
+        }
+        delete[] table;
+    }
+
+    bool get(const int64_t& key, int64_t& value)
+    {
+        Node* cur = ptr(table[key % table_size].load());
+        while (cur != NULL && cur->key < key)
+            cur = ptr(cur->next.load());
+        if (cur == NULL || cur->key != key || marked(cur->next.load()))
+            return false;
+        value = cur->value.load();
+        return true;
+    }
+
+    void put(const int64_t key, const int64_t value)
+    {
+        atomic<uintptr_t>* bucket = &table[key % table_size];
+        Node* node = NULL;
+        while (true) {
+            atomic<uintptr_t>* prev;
+            Node* cur;
+            find(bucket, key, prev, cur);
+            if (cur != NULL && cur->key == key) {
+                cur->value.store(value);
+                delete node;
+                return;
+            }
+            if (node == NULL)
+                node = new Node(key, value, (uintptr_t) cur);
+            else
+                node->next.store((uintptr_t) cur);
+            uintptr_t expected = (uintptr_t) cur;
+            if (prev->compare_exchange_strong(expected, (uintptr_t) node)) {
+                count++;
+                return;
+            }
+        }
+    }
+
+    void remove(const int64_t& key)
+    {
+        atomic<uintptr_t>* bucket = &table[key % table_size];
+        while (true) {
+            atomic<uintptr_t>* prev;
+            Node* cur;
+            find(bucket, key, prev, cur);
+            if (cur == NULL || cur->key != key)
+                return;
+            uintptr_t next = cur->next.load();
+            if (marked(next))
+                continue;
+            if (!cur->next.compare_exchange_strong(next, next | 1))
+                continue;
+            // the node is removed, try to unlink it now, else a later find does
+            uintptr_t expected = (uintptr_t) cur;
+            prev->compare_exchange_strong(expected, next);
+            retire(cur);
+            count--;
+            return;
+        }
+    }
+
+    // Number of keys, exact once concurrent updates are done
+    size_t size()
+    {
+        return count.load();
+    }
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef LOCK_FREE_SKIP_LIST_HPP
+#define LOCK_FREE_SKIP_LIST_HPP
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "stm.hpp"
+
+// Baseline for the ordered sets without the STM, see bench --type
+// skip-lockfree. The lock-free skip list of Fraser and of Herlihy and
+// Shavit: a delete marks the low bit of the node's next pointers from the
+// top level down, and the mark on level 0 decides which delete wins. Searches
+// unlink marked nodes as they pass them. Deleted nodes are only freed with
+// the list, since a concurrent search may still be on them, so memory grows
+// with the number of deletes. Not for use inside transactions
+using namespace std;
+
+#define LF_SKIP_LIST_MAX_LEVEL 32
+
+class LockFreeSkipList {
+    struct Node {
+        int64_t val;
+        int level; // number of next pointers, fixed at creation
+        Node* retiredNext;
+        atomic<uintptr_t> next[]; // sized by level, low bit set once deleted
+
+        static Node* create(int64_t val, int level)
+        {
+            Node* node = (Node*) malloc(sizeof(Node) + level * sizeof(atomic<uintptr_t>));
+            node->val = val;
+            node->level = level;
+            node->retiredNext = NULL;
+            for (int i = 0; i < level; i++)
+                new (&node->next[i]) atomic<uintptr_t>(0);
+            return node;
+        }
+    };
+
+    static bool marked(uintptr_t p) { return p & 1; }
+    static Node* ptr(uintptr_t p) { return (Node*) (p & ~(uintptr_t) 1); }
+
+    Node* head; // sentinel spanning every level
+    atomic<Node*> retired; // deleted nodes, freed by the destructor
+    atomic<int64_t> count;
+
+    // geometric level with p = 1/2, as in SkipList
+    static int randomLevel()
+    {
+        static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL * (_my_thread.id + 1);
+        // xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int level = 1;
+        uint64_t bits = state;
+        while ((bits & 1) && level < LF_SKIP_LIST_MAX_LEVEL) {
+            level++;
+            bits >>= 1;
+        }
+        return level;
+    }
+
+    void retire(Node* node)
+    {
+        Node* first = retired.load();
+        do {
+            node->retiredNext = first;
+        } while (!retired.compare_exchange_weak(first, node));
+    }
+
+    // Fills preds[i] and succs[i] with the last node on level i whose key is
+    // < key and the node after it, unlinking the marked nodes on the way.
+    // Returns whether succs[0] holds key
+    bool find(int64_t key, Node** preds, Node** succs)
+    {
+    retry:
+        Node* pred = head;
+        for (int i = LF_SKIP_LIST_MAX_LEVEL - 1; i >= 0; i--) {
+            Node* cur = ptr(pred->next[i].load());
+            while (cur != NULL) {
+                uintptr_t succ = cur->next[i].load();
+                if (marked(succ)) {
+                    uintptr_t expected = (uintptr_t) cur;
+                    if (!pred->next[i].compare_exchange_strong(expected, (uintptr_t) ptr(succ)))
+                        goto retry;
+                    cur = ptr(succ);
+                } else if (cur->val < key) {
+                    pred = cur;
+                    cur = ptr(succ);
+                } else {
+                    break;
+                }
+            }
+            preds[i] = pred;
+            succs[i] = cur;
+        }
+        return succs[0] != NULL && succs[0]->val == key;
+    }
+
+public:
+    LockFreeSkipList()
+        : head(Node::create(INT64_MIN, LF_SKIP_LIST_MAX_LEVEL))
+        , retired(NULL)
+        , count(0)
+    {
+    }
+
+    // Not safe while other threads still use the list
+    ~LockFreeSkipList()
+    {
+        Node* node = ptr(head->next[0].load());
+        while (node != NULL) {
+            uintptr_t next = node->next[0].load();
+            // a marked node is also on the retired list
+            if (!marked(next))
+                free(node);
+            node = ptr(next);
+        }
+        node = retired.load();
+        while (node != NULL) {
+            Node* next = node->retiredNext;
+            free(node);
+            node = next;
+        }
+        free(head);
+    }
+
+    bool insert(int64_t n)
+    {
+        Node* preds[LF_SKIP_LIST_MAX_LEVEL];
+        Node* succs[LF_SKIP_LIST_MAX_LEVEL];
+        int level = randomLevel();
+        Node* node = Node::create(n, level);
+        while (true) {
+            if (find(n, preds, succs)) {
+                free(node);
+                return false;
+            }
+            for (int i = 0; i < level; i++)
+                node->next[i].store((uintptr_t) succs[i]);
+            uintptr_t expected = (uintptr_t) succs[0];
+            if (preds[0]->next[0].compare_exchange_strong(expected, (uintptr_t) node))
+                break;
+        }
+        count++;
+        // the node is in the set, link the levels above
+        for (int i = 1; i < level; i++) {
+            while (true) {
+                uintptr_t next = node->next[i].load();
+                if (marked(next))
+                    return true; // already being deleted, stop linking it
+                if (ptr(next) != succs[i] && !node->next[i].compare_exchange_strong(next, (uintptr_t) succs[i]))
+                    continue;
+                uintptr_t expected = (uintptr_t) succs[i];
+                if (preds[i]->next[i].compare_exchange_strong(expected, (uintptr_t) node))
+                    break;
+                find(n, preds, succs);
+                if (succs[0] != node)
+                    return true; // deleted in the meantime
+            }
+        }
+        return true;
+    }
+
+    bool deleteKey(int64_t n)
+    {
+        Node* preds[LF_SKIP_LIST_MAX_LEVEL];
+        Node* succs[LF_SKIP_LIST_MAX_LEVEL];
+        if (!find(n, preds, succs))
+            return false;
+        Node* node = succs[0];
+        for (int i = node->level - 1; i >= 1; i--) {
+            uintptr_t next = node->next[i].load();
+            while (!marked(next))
+                node->next[i].compare_exchange_weak(next, next | 1);
+        }
+        uintptr_t next = node->next[0].load();
+        while (true) {
+            if (marked(next))
+                return false; // another delete won
+            if (node->next[0].compare_exchange_strong(next, next | 1))
+                break;
+        }
+        count--;
+        retire(node);
+        find(n, preds, succs); // unlink it
+        return true;
+    }
+
+    // Never writes, passes over marked nodes instead of unlinking them
+    bool get(int64_t key)
+    {
+        Node* pred = head;
+        Node* cur = NULL;
+        for (int i = LF_SKIP_LIST_MAX_LEVEL - 1; i >= 0; i--) {
+            cur = ptr(pred->next[i].load());
+            while (cur != NULL) {
+                uintptr_t succ = cur->next[i].load();
+                if (marked(succ)) {
+                    cur = ptr(succ);
+                } else if (cur->val < key) {
+                    pred = cur;
+                    cur = ptr(succ);
+                } else {
+                    break;
+                }
+            }
+        }
+        return cur != NULL && cur->val == key;
+    }
+
+    // Keys in order, exact once concurrent updates are done
+    vector<int64_t> inorder()
+    {
+        vector<int64_t> res;
+        for (Node* x = ptr(head->next[0].load()); x != NULL; x = ptr(x->next[0].load())) {
+            if (!marked(x->next[0].load()))
+                res.push_back(x->val);
+        }
+        return res;
+    }
+
+    size_t size()
+    {
+        return count.load();
+    }
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef PRIORITY_QUEUE_HPP
+#define PRIORITY_QUEUE_HPP
+#include <iostream>
+#include <vector>
+#include "stm.hpp"
+#include "TxCounter.hpp"
+
+// Pairing heaps based on https://en.wikipedia.org/wiki/Pairing_heap
+using namespace std;
+
+#define LOAD_PN(addr) ((PairingNode*) LOAD(addr))
+#define PQ_MAX_HEAPS COUNTER_STRIPES
+
+class PairingNode {
+public:
+    int64_t key;
+    PairingNode* child; // leftmost child
+    PairingNode* sibling; // next sibling to the right
+
+    PairingNode(int64_t key) : key(key), child(NULL), sibling(NULL) {}
+};
+
+// Min priority queue made of numHeaps pairing heaps. A thread pushes into the
+// heap picked by its id, so pushes from different threads do not conflict, and
+// a push only writes a root or one child pointer.
+// popMin is exact: it reads every root and pops the smallest. In relaxed mode
+// popMin instead looks at 2 random heaps and pops the smaller root, so two
+// concurrent pops usually touch different roots. The key returned is then
+// among the smallest few (rank O(numHeaps) in expectation) rather than the
+// minimum. peek is always exact.
+class PriorityQueue {
+    struct alignas(CACHE_LINE_SIZE) Heap {
+        PairingNode* root;
+    };
+    Heap heaps[PQ_MAX_HEAPS];
+    int numHeaps;
+    bool relaxed;
+    TxCounter count;
+
+    // links two heaps, the larger root becomes the leftmost child of the smaller
+    static PairingNode* meld(PairingNode* a, PairingNode* b)
+    {
+        if (a == NULL)
+            return b;
+        if (b == NULL)
+            return a;
+        if (LOAD(b->key) < LOAD(a->key))
+            swap(a, b);
+        STORE(b->sibling, LOAD_PN(a->child));
+        STORE(a->child, b);
+        return a;
+    }
+
+    // two pass pairing of a sibling list: meld pairs left to right, then
+    // meld the results right to left. meld rewrites the sibling of every
+    // node that ends up under another one, so only the new root's is cleared
+    static PairingNode* mergePairs(PairingNode* first)
+    {
+        boost::container::small_vector<PairingNode*, 32> pairs;
+        while (first != NULL) {
+            PairingNode* a = first;
+            PairingNode* b = LOAD_PN(a->sibling);
+            first = b == NULL ? NULL : LOAD_PN(b->sibling);
+            pairs.push_back(meld(a, b));
+        }
+        PairingNode* result = NULL;
+        for (auto it = pairs.rbegin(); it != pairs.rend(); ++it)
+            result = meld(*it, result);
+        if (result != NULL)
+            STORE(result->sibling, NULL);
+        return result;
+    }
+
+    // thread private xorshift, picking heaps never conflicts
+    static uint64_t nextRandom()
+    {
+        static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL * (_my_thread.id + 1);
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    // heap with the smallest root, or -1 if every heap is empty
+    int minHeap()
+    {
+        int best = -1;
+        int64_t bestKey = 0;
+        for (int i = 0; i < numHeaps; i++) {
+            PairingNode* r = LOAD_PN(heaps[i].root);
+            if (r != NULL && (best == -1 || LOAD(r->key) < bestKey)) {
+                best = i;
+                bestKey = LOAD(r->key);
+            }
+        }
+        return best;
+    }
+
+    void popFrom(int i, int64_t& key)
+    {
+        PairingNode* r = LOAD_PN(heaps[i].root);
+        key = LOAD(r->key);
+        STORE(heaps[i].root, mergePairs(LOAD_PN(r->child)));
+        FREE(r);
+        count.decrement();
+    }
+
+public:
+    // numHeaps is capped at PQ_MAX_HEAPS
+    PriorityQueue(int numHeaps = 1, bool relaxed = false)
+        : heaps {}
+        , numHeaps(max(1, min(numHeaps, PQ_MAX_HEAPS)))
+        , relaxed(relaxed)
+    {}
+
+    void push(int64_t key)
+    {
+        Heap& h = heaps[_my_thread.id % numHeaps];
+        void* nodeMem = MALLOC(sizeof(PairingNode));
+        PairingNode* n = new (nodeMem) PairingNode(key);
+        STORE(h.root, meld(LOAD_PN(h.root), n));
+        count.increment();
+    }
+
+    // removes the smallest key (see the relaxed mode above), returns false
+    // only if the queue is empty
+    bool popMin(int64_t& key)
+    {
+        int i = -1;
+        if (relaxed && numHeaps > 1) {
+            int a = nextRandom() % numHeaps;
+            int b = nextRandom() % numHeaps;
+            PairingNode* ra = LOAD_PN(heaps[a].root);
+            PairingNode* rb = LOAD_PN(heaps[b].root);
+            if (ra != NULL && (rb == NULL || LOAD(ra->key) <= LOAD(rb->key)))
+                i = a;
+            else if (rb != NULL)
+                i = b;
+        }
+        if (i == -1) {
+            // exact mode, or both picks were empty
+            i = minHeap();
+            if (i == -1)
+                return false;
+        }
+        popFrom(i, key);
+        return true;
+    }
+
+    // smallest key without removing it, returns false if empty
+    bool peek(int64_t& key)
+    {
+        int i = minHeap();
+        if (i == -1)
+            return false;
+        key = LOAD(LOAD_PN(heaps[i].root)->key);
+        return true;
+    }
+
+    // Number of keys, O(threads) instead of a full walk
+    size_t size()
+    {
+        return count.get();
+    }
+
+    // Non-transactional estimate of size(), never causes an abort
+    size_t sizeApprox()
+    {
+        return count.approx();
+    }
+};
+
+#endif
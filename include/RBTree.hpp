@@ -2,7 +2,11 @@
 #define RB_TREE_HPP
 #include <iostream>
 #include <vector>
+#include <iterator>
+#include <optional>
+#include <functional>
 #include "stm.hpp"
+#include "TxCounter.hpp"
 
 // Red black tree implementation based on https://www.geeksforgeeks.org/deletion-in-red-black-tree/
 using namespace std;
@@ -14,18 +18,28 @@ using namespace std;
 // enum COLOR { RED,
 //     BLACK };
 
-class Node {
+// The value sits next to the key, so a lookup reads both from the same node
+template <typename K, typename V>
+class RBNode {
+    typedef RBNode Node;
+
 public:
-    int64_t val;
+    K key;
+    V value;
     COLOR color;
     Node *left, *right, *parent;
+    int64_t deleted; // Tombstone, only set by relaxed trees
+    int64_t deficit; // Relaxed trees: paths through this node are one black short
 
-    Node(int val)
-        : val(val)
+    RBNode(const K& key, const V& value)
+        : key(key)
+        , value(value)
         , color(RED) // Node is red at insertion
         , left(NULL)
         , right(NULL)
         , parent(NULL)
+        , deleted(0)
+        , deficit(0)
     {}
 
     // returns pointer to uncle
@@ -80,8 +94,71 @@ public:
     }
 };
 
+// Work left behind by a relaxed update, keyed by key since the node may move or be freed
+template <typename K>
+class RBRepairEntry {
+public:
+    K key;
+    RBRepairEntry* next;
+
+    RBRepairEntry(const K& key, RBRepairEntry* next) : key(key), next(next) {}
+};
+
+// Ordered map from K to V, ordered by Compare. Keys and values are copied in
+// and out of the nodes word by word (LOAD_VALUE), so both must be trivially
+// copyable. With the defaults it is the int64_t set the benchmarks use.
+template <typename K = int64_t, typename V = int64_t, typename Compare = less<K>>
 class RBTree {
+    typedef RBNode<K, V> Node;
+    typedef RBRepairEntry<K> RepairEntry;
+
     Node* root;
+    TxCounter count;
+
+    // Relaxed mode: insert and deleteKey skip rebalancing and only record what
+    // needs repair, rebalance() does the repairs later in small transactions
+    bool relaxed;
+    // Per thread stacks of pending repairs, one cache line each like TxCounter
+    struct alignas(CACHE_LINE_SIZE) RepairSlot {
+        RepairEntry* redRed; // keys of red nodes that may have a red parent
+        RepairEntry* doubleBlack; // keys of nodes with a deficit
+        RepairEntry* tombstones; // keys of logically deleted nodes
+    };
+    RepairSlot repairs[COUNTER_STRIPES];
+    Compare comp;
+    // get and find release the search path as they go, see lookup
+    bool earlyRelease;
+
+    bool equal(const K& a, const K& b) { return !comp(a, b) && !comp(b, a); }
+
+    void pushRepair(RepairEntry*& head, const K& key)
+    {
+        void* entryMem = MALLOC(sizeof(RepairEntry));
+        RepairEntry* entry = new(entryMem) RepairEntry(key, (RepairEntry*) LOAD(head));
+        STORE(head, entry);
+    }
+
+    // pops the most recent entry off head, returns false if empty
+    bool popRepair(RepairEntry*& head, K& key)
+    {
+        RepairEntry* entry = (RepairEntry*) LOAD(head);
+        if (entry == NULL)
+            return false;
+        key = LOAD_VALUE(entry->key);
+        STORE(head, LOAD(entry->next));
+        FREE(entry);
+        return true;
+    }
+
+    RepairSlot& mySlot()
+    {
+        return repairs[_my_thread.id % COUNTER_STRIPES];
+    }
+
+    bool isDeleted(Node* n)
+    {
+        return relaxed && LOAD(n->deleted);
+    }
 
     // left rotates the given node
     void leftRotate(Node* x)
@@ -139,9 +216,46 @@ class RBTree {
 
     void swapValues(Node* u, Node* v)
     {
-        int64_t temp = LOAD(u->val);
-        STORE(u->val, LOAD(v->val));
-        STORE(v->val, temp);
+        K tempKey = LOAD_VALUE(u->key);
+        STORE_VALUE(u->key, LOAD_VALUE(v->key));
+        STORE_VALUE(v->key, tempKey);
+        V tempValue = LOAD_VALUE(u->value);
+        STORE_VALUE(u->value, LOAD_VALUE(v->value));
+        STORE_VALUE(v->value, tempValue);
+        if (relaxed) {
+            // tombstone travels with the value
+            int64_t tempDeleted = LOAD(u->deleted);
+            STORE(u->deleted, LOAD(v->deleted));
+            STORE(v->deleted, tempDeleted);
+        }
+    }
+
+    // LR, LL, RL, RR cases of a red red violation between x and parent
+    // when the uncle is black
+    void rotateRedRed(Node* x, Node* parent, Node* grandparent)
+    {
+        if (parent->isOnLeft()) {
+            if (x->isOnLeft()) {
+                // for left right
+                swapColors(parent, grandparent);
+            } else {
+                leftRotate(parent);
+                swapColors(x, grandparent);
+            }
+            // for left left and left right
+            rightRotate(grandparent);
+        } else {
+            if (x->isOnLeft()) {
+                // for right left
+                rightRotate(parent);
+                swapColors(x, grandparent);
+            } else {
+                swapColors(parent, grandparent);
+            }
+
+            // for right right and right left
+            leftRotate(grandparent);
+        }
     }
 
     // fix red red at given node
@@ -167,35 +281,263 @@ class RBTree {
                 fixRedRed(grandparent);
             } else {
                 // Else perform LR, LL, RL, RR
-                if (parent->isOnLeft()) {
-                    if (x->isOnLeft()) {
-                        // for left right
-                        swapColors(parent, grandparent);
-                    } else {
-                        leftRotate(parent);
-                        swapColors(x, grandparent);
-                    }
-                    // for left left and left right
-                    rightRotate(grandparent);
+                rotateRedRed(x, parent, grandparent);
+            }
+        }
+    }
+
+    bool isRedRed(Node* x)
+    {
+        if (LOAD(x->color) != RED)
+            return false;
+        Node* parent = LOAD_NODE(x->parent);
+        return parent != NULL && LOAD(parent->color) == RED;
+    }
+
+    // Every red node with a red parent has a pending redRed entry keyed by the
+    // child. Called on nodes whose color or parent a relaxed step changed in a
+    // way that could create a violation the existing entries do not cover.
+    void queueIfRedRed(Node* x)
+    {
+        if (x != NULL && isRedRed(x))
+            pushRepair(mySlot().redRed, LOAD_VALUE(x->key));
+    }
+
+    // queueIfRedRed on the top of a rotated subtree and the two levels below it
+    void queueSubtreeRedRed(Node* top)
+    {
+        queueIfRedRed(top);
+        Node* children[2] = { LOAD_NODE(top->left), LOAD_NODE(top->right) };
+        for (Node* child : children) {
+            if (child == NULL)
+                continue;
+            queueIfRedRed(child);
+            queueIfRedRed(LOAD_NODE(child->left));
+            queueIfRedRed(LOAD_NODE(child->right));
+        }
+    }
+
+    // One local step of relaxed red red repair for x. Other violations may be
+    // pending, and a step is only valid where the grandparent is black, so when
+    // x's grandparent is red the step is taken at the topmost violation above x
+    // and x is queued again. That way x is never popped again before the
+    // violation above it is gone. A step writes 3 colors (uncle red) or does at
+    // most 2 rotations and 2 color swaps (uncle black), plus one repair entry.
+    void relaxedFixRedRed(Node* x)
+    {
+        if (!isRedRed(x)) {
+            if (x == LOAD_NODE(root) && LOAD(x->color) != BLACK)
+                STORE(x->color, BLACK);
+            return;
+        }
+
+        // climb to the topmost violation on x's path, loads only
+        Node* top = x;
+        Node* parent = LOAD_NODE(top->parent);
+        Node* grandparent = LOAD_NODE(parent->parent);
+        while (grandparent != NULL && LOAD(grandparent->color) == RED) {
+            top = parent;
+            parent = grandparent;
+            grandparent = LOAD_NODE(parent->parent);
+        }
+
+        if (grandparent == NULL) {
+            // red root, recolor
+            STORE(parent->color, BLACK);
+        } else {
+            Node* uncle = top->uncle();
+            if (uncle != NULL && LOAD(uncle->color) == RED) {
+                STORE(parent->color, BLACK);
+                STORE(uncle->color, BLACK);
+                STORE(grandparent->color, RED);
+                // the violation may have moved up, repair it in a later step
+                queueIfRedRed(grandparent);
+            } else {
+                // entries below stay keyed by the same red children
+                rotateRedRed(top, parent, grandparent);
+            }
+        }
+
+        if (top != x)
+            queueIfRedRed(x);
+    }
+
+    // One step of double black repair at x, which is either a black leaf about to
+    // be unlinked or a node with a deficit. Same cases as fixDoubleBlack, except
+    // that pushing the double black up does not recurse: the parent gets a
+    // deficit and a doubleBlack entry for a later step. Deficits compose with
+    // other pending work because every case only adds one black to the paths
+    // through x and keeps the black count of every other subtree. Returns
+    // false without writing anything when a pending red red violation at the
+    // parent or sibling, or a deficit already at the parent, has to go first,
+    // or when a red sibling has no inner child to become the new sibling.
+    // Writes at most 2 rotations and 4 colors, or 1 color, a flag and an entry.
+    bool relaxedFixDoubleBlack(Node* x, Node* parent)
+    {
+        Node* sibling = x->sibling();
+        if (sibling == NULL)
+            return false;
+        if (LOAD(sibling->color) == RED) {
+            // needs a black parent and black nephews, and the inner nephew
+            // becomes the new sibling so it must exist
+            if (LOAD(parent->color) == RED || sibling->hasRedChild())
+                return false;
+            Node* inner = sibling->isOnLeft() ? LOAD_NODE(sibling->right) : LOAD_NODE(sibling->left);
+            if (inner == NULL)
+                return false;
+            STORE(parent->color, RED);
+            STORE(sibling->color, BLACK);
+            if (sibling->isOnLeft())
+                rightRotate(parent);
+            else
+                leftRotate(parent);
+            // the new sibling is black and the parent red, one of the cases below finishes
+            sibling = x->sibling();
+        }
+
+        if (sibling->hasRedChild()) {
+            // same rotations as fixDoubleBlack
+            if (LOAD_NODE(sibling->left) != NULL && LOAD(LOAD_NODE(sibling->left)->color) == RED) {
+                if (sibling->isOnLeft()) {
+                    // left left
+                    STORE(LOAD_NODE(sibling->left)->color, LOAD(sibling->color));
+                    STORE(sibling->color, LOAD(parent->color));
+                    rightRotate(parent);
                 } else {
-                    if (x->isOnLeft()) {
-                        // for right left
-                        rightRotate(parent);
-                        swapColors(x, grandparent);
-                    } else {
-                        swapColors(parent, grandparent);
-                    }
+                    // right left
+                    STORE(LOAD_NODE(sibling->left)->color, LOAD(parent->color));
+                    rightRotate(sibling);
+                    leftRotate(parent);
+                }
+            } else {
+                if (sibling->isOnLeft()) {
+                    // left right
+                    STORE(LOAD_NODE(sibling->right)->color, LOAD(parent->color));
+                    leftRotate(sibling);
+                    rightRotate(parent);
+                } else {
+                    // right right
+                    STORE(LOAD_NODE(sibling->right)->color, LOAD(sibling->color));
+                    STORE(sibling->color, LOAD(parent->color));
+                    leftRotate(parent);
+                }
+            }
+            STORE(parent->color, BLACK);
+            // the new top took the parent's color and red nephews moved
+            queueSubtreeRedRed(LOAD_NODE(parent->parent));
+            return true;
+        }
+
+        if (LOAD(parent->color) == RED) {
+            STORE(sibling->color, RED);
+            STORE(parent->color, BLACK);
+            return true;
+        }
+
+        // 2 black children under a black parent, push the double black up
+        if (parent != LOAD_NODE(root)) {
+            if (LOAD(parent->deficit))
+                return false;
+            STORE(parent->deficit, 1);
+            pushRepair(mySlot().doubleBlack, LOAD_VALUE(parent->key));
+        }
+        STORE(sibling->color, RED);
+        return true;
+    }
 
-                    // for right right and right left
-                    leftRotate(grandparent);
+    // Unlinks tombstone v in one local step. A node with two children first
+    // trades places with its successor, so the removed node has at most one
+    // child. Returns false when it has to wait for other pending repairs: a
+    // deficit on either node, a black only child (a deficit below it), or
+    // relaxedFixDoubleBlack refusing.
+    bool relaxedUnlink(Node* v)
+    {
+        if (LOAD_NODE(v->left) != NULL && LOAD_NODE(v->right) != NULL) {
+            Node* u = successor(LOAD_NODE(v->right));
+            // deficits are found by key, keep them on their nodes
+            if (LOAD(u->deficit) || LOAD(v->deficit))
+                return false;
+            swapValues(u, v);
+            // v now holds u's key, keep its violation covered
+            queueIfRedRed(v);
+            v = u;
+        }
+        if (LOAD(v->deficit))
+            return false;
+
+        Node* parent = LOAD_NODE(v->parent);
+        Node* child = LOAD_NODE(v->left) != NULL ? LOAD_NODE(v->left) : LOAD_NODE(v->right);
+
+        if (child != NULL && LOAD(v->color) == BLACK && LOAD(child->color) == BLACK)
+            return false;
+        if (child == NULL && LOAD(v->color) == BLACK && parent != NULL
+            && !relaxedFixDoubleBlack(v, parent))
+            return false;
+
+        // black counts are balanced from here: v is red, the root, a black leaf
+        // whose double black was handled, or black with a single red child that
+        // takes over its color
+        if (parent == NULL) {
+            STORE(root, child);
+        } else if (v->isOnLeft()) {
+            STORE(parent->left, child);
+        } else {
+            STORE(parent->right, child);
+        }
+        if (child != NULL) {
+            STORE(child->parent, parent);
+            if (LOAD(v->color) == BLACK)
+                STORE(child->color, BLACK);
+            else
+                queueIfRedRed(child);
+        }
+        FREE(v);
+        return true;
+    }
+
+    enum RepairResult { NO_REPAIR, REPAIRED, DEFERRED };
+
+    // One repair transaction on slot i. Red red violations go first since
+    // they never wait on anything, then deficits, then tombstones. An entry
+    // that has to wait is pushed back onto its list.
+    RepairResult repairStep(int i)
+    {
+        RepairResult result;
+        TxBegin();
+        result = NO_REPAIR;
+        K key {};
+        if (popRepair(repairs[i].redRed, key)) {
+            Node* x = search(key);
+            if (x != NULL && equal(LOAD_VALUE(x->key), key))
+                relaxedFixRedRed(x);
+            result = REPAIRED;
+        } else if (popRepair(repairs[i].doubleBlack, key)) {
+            Node* x = search(key);
+            result = REPAIRED;
+            if (x != NULL && equal(LOAD_VALUE(x->key), key) && LOAD(x->deficit)) {
+                Node* parent = LOAD_NODE(x->parent);
+                if (parent == NULL || relaxedFixDoubleBlack(x, parent)) {
+                    STORE(x->deficit, 0);
+                } else {
+                    pushRepair(repairs[i].doubleBlack, key);
+                    result = DEFERRED;
                 }
             }
+        } else if (popRepair(repairs[i].tombstones, key)) {
+            Node* v = search(key);
+            result = REPAIRED;
+            if (v != NULL && equal(LOAD_VALUE(v->key), key) && LOAD(v->deleted) && !relaxedUnlink(v)) {
+                pushRepair(repairs[i].tombstones, key);
+                result = DEFERRED;
+            }
         }
+        TxEnd();
+        return result;
     }
 
     // find node that do not have a left child
     // in the subtree of the given node
-    Node* successor(Node* x)
+    static Node* successor(Node* x)
     {
         Node* temp = x;
 
@@ -257,7 +599,6 @@ class RBTree {
                 }
             }
             // delete v; // TODO handle memory management
-            // v->~Node();
             FREE(v);
             return;
         }
@@ -265,8 +606,9 @@ class RBTree {
         if (LOAD_NODE(v->left) == NULL || LOAD_NODE(v->right) == NULL) {
             // v has 1 child
             if (v == LOAD_NODE(root)) {
-                // v is root, assign the value of u to v, and delete u
-                STORE(v->val, u->val);
+                // v is root, assign the key and value of u to v, and delete u
+                STORE_VALUE(v->key, LOAD_VALUE(u->key));
+                STORE_VALUE(v->value, LOAD_VALUE(u->value));
                 STORE(v->left, NULL);
                 STORE(v->right, NULL);
                 // delete u; // TODO handle memory management
@@ -365,33 +707,53 @@ class RBTree {
     }
 
     // prints inorder recursively
-    void inorderHelp(Node* x, vector<int>& v)
+    void inorderHelp(Node* x, vector<K>& v)
     {
         if (x == NULL)
             return;
         inorderHelp(x->left, v);
-        v.push_back(x->val);
+        if (!(relaxed && x->deleted))
+            v.push_back(x->key);
         inorderHelp(x->right, v);
     }
 
-    size_t sizeHelp(Node* n)
+    // node holding key or NULL. With early release only the last node's key
+    // and the link to the next node stay in the read set, hand over hand:
+    // a found node is freed or rewritten when its key goes away, and an
+    // insert of a missing key has to write the NULL link the lookup ended on
+    Node* lookup(const K& key)
     {
-        if (!n)
-            return 0;
-        return 1 + sizeHelp(n->left) + sizeHelp(n->right);
+        Node** link = &root;
+        Node* n = LOAD_NODE(root);
+        while (n != NULL) {
+            K nKey = LOAD_VALUE(n->key);
+            if (equal(nKey, key))
+                return n;
+            Node** next = comp(nKey, key) ? &n->right : &n->left;
+            Node* child = LOAD_NODE(*next);
+            if (earlyRelease && child != NULL) {
+                RELEASE(*link);
+                RELEASE_VALUE(n->key);
+            }
+            link = next;
+            n = child;
+        }
+        return NULL;
     }
 
-    bool getHelp(Node* n, int64_t key)
+    // next node in key order, climbing parent pointers when there is no right subtree
+    static Node* nextNode(Node* x)
     {
-        if (!n)
-            return false;
-        if (LOAD(n->val) == key) {
-            return true;
-        }
-        if (LOAD(n->val) < key) {
-            return getHelp(LOAD_NODE(n->right), key);
+        Node* right = LOAD_NODE(x->right);
+        if (right != NULL)
+            return successor(right);
+
+        Node* parent = LOAD_NODE(x->parent);
+        while (parent != NULL && x == LOAD_NODE(parent->right)) {
+            x = parent;
+            parent = LOAD_NODE(parent->parent);
         }
-        return getHelp(LOAD_NODE(n->left), key);
+        return parent;
     }
 
     int maxHeightHelp(Node *n){
@@ -400,25 +762,88 @@ class RBTree {
     }
 
 public:
+    // Forward iterator in key order. Only holds the current node, every step is
+    // a few instrumented loads, so it is cheap inside read only transactions.
+    // Must not be used across transactions.
+    class iterator {
+        Node* node;
+        bool skipDeleted;
+
+        void skipTombstones()
+        {
+            while (skipDeleted && node != NULL && LOAD(node->deleted))
+                node = nextNode(node);
+        }
+
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = K;
+        using difference_type = ptrdiff_t;
+        using pointer = const K*;
+        // keys are read through LOAD_VALUE, so dereferencing yields a copy
+        using reference = K;
+
+        iterator() : node(NULL), skipDeleted(false) {}
+        explicit iterator(Node* node, bool skipDeleted = false)
+            : node(node)
+            , skipDeleted(skipDeleted)
+        {
+            skipTombstones();
+        }
+
+        K operator*() const { return LOAD_VALUE(node->key); }
+
+        // value stored under the current key
+        V value() const { return LOAD_VALUE(node->value); }
+
+        iterator& operator++()
+        {
+            node = nextNode(node);
+            skipTombstones();
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator old = *this;
+            ++(*this);
+            return old;
+        }
+
+        bool operator==(const iterator& other) const { return node == other.node; }
+        bool operator!=(const iterator& other) const { return node != other.node; }
+    };
+
     // constructor
     // initialize root
-    RBTree() { root = NULL; }
+    // relaxed: defer rebalancing to rebalance(), see relaxedFixRedRed
+    RBTree(bool relaxed = false)
+        : root(NULL)
+        , relaxed(relaxed)
+        , repairs {}
+        , earlyRelease(false)
+    {}
+
+    // Opt in to early release in get and find. Updates keep their full read
+    // set, they rely on the path for where to link and how to rebalance
+    void setEarlyRelease(bool enable) { earlyRelease = enable; }
 
     Node* getRoot() { return root; }
 
     // searches for given value
     // if found returns the node (used for delete)
     // else returns the last node while traversing (used in insert)
-    Node* search(int64_t n)
+    Node* search(const K& n)
     {
         Node* temp = LOAD_NODE(root);
         while (temp != NULL) {
-            if (n < LOAD(temp->val)) {
+            K tempKey = LOAD_VALUE(temp->key);
+            if (comp(n, tempKey)) {
                 if (LOAD_NODE(temp->left) == NULL)
                     break;
                 else
                     temp = LOAD_NODE(temp->left);
-            } else if (n == LOAD(temp->val)) {
+            } else if (!comp(tempKey, n)) {
                 break;
             } else {
                 if (LOAD_NODE(temp->right) == NULL)
@@ -431,45 +856,86 @@ public:
         return temp;
     }
 
-    // inserts the given value to tree
-    void insert(int64_t n)
+    // inserts key with the given value to tree, or when assign is set
+    // overwrites the value of an existing key
+    // returns false if the key was already present
+    bool insertHelp(const K& n, const V& value, bool assign)
     {
+        Node* temp = search(n);
+
+        if (temp != NULL && equal(LOAD_VALUE(temp->key), n)) {
+            if (isDeleted(temp)) {
+                // revive the tombstone, its repair entry will find it live
+                STORE(temp->deleted, 0);
+                STORE_VALUE(temp->value, value);
+                count.increment();
+                return true;
+            }
+            if (assign)
+                STORE_VALUE(temp->value, value);
+            // return if key already exists
+            return false;
+        }
+
         // Node* newNode = new Node(n);
         void* newNodeMem = MALLOC(sizeof(Node));
         // The "placement new"
-        Node* newNode = new(newNodeMem) Node(n);
+        Node* newNode = new(newNodeMem) Node(n, value);
 
-        if (LOAD_NODE(root) == NULL) {
+        if (temp == NULL) {
             // when root is null
             // simply insert value at root
             newNode->color = BLACK;
             STORE(root, newNode);
         } else {
-            Node* temp = search(n);
-
-            if (LOAD(temp->val) == n) {
-                // return if value already exists
-                return;
-            }
-
             // if value is not found, search returns the node
             // where the value is to be inserted
 
             // connect new node to correct node
             newNode->parent = temp;
 
-            if (n < LOAD(temp->val))
+            if (comp(n, LOAD_VALUE(temp->key)))
                 STORE(temp->left, newNode);
             else
                 STORE(temp->right, newNode);
 
-            // fix red red voilaton if exists
-            fixRedRed(newNode);
+            if (!relaxed) {
+                // fix red red voilaton if exists
+                fixRedRed(newNode);
+            } else if (LOAD(temp->color) == RED) {
+                // leave the violation for rebalance()
+                pushRepair(mySlot().redRed, n);
+            }
         }
+        count.increment();
+        return true;
+    }
+
+    // inserts the given key with a default value
+    // returns false if the key was already present
+    bool insert(const K& n)
+    {
+        return insertHelp(n, V(), false);
+    }
+
+    // inserts the key or overwrites its value
+    // returns true if the key was inserted, false if it was assigned
+    bool insert_or_assign(const K& n, const V& value)
+    {
+        return insertHelp(n, value, true);
+    }
+
+    // value stored under key, if present
+    optional<V> find(const K& key)
+    {
+        Node* n = lookup(key);
+        if (n == NULL || isDeleted(n))
+            return nullopt;
+        return LOAD_VALUE(n->value);
     }
 
-    // utility function that deletes the node with given value
-    bool deleteKey(int64_t n)
+    // utility function that deletes the node with given key
+    bool deleteKey(const K& n)
     {
         if (LOAD_NODE(root) == NULL)
             // Tree is empty
@@ -477,29 +943,121 @@ public:
 
         Node* v = search(n);
 
-        if (LOAD(v->val) != n) {
+        if (!equal(LOAD_VALUE(v->key), n)) {
             return false;
         }
 
+        if (relaxed) {
+            // only mark it, rebalance() unlinks it
+            if (LOAD(v->deleted))
+                return false;
+            STORE(v->deleted, 1);
+            pushRepair(mySlot().tombstones, n);
+            count.decrement();
+            return true;
+        }
+
         deleteNode(v);
+        count.decrement();
         return true;
     }
 
-    vector<int> inorder()
+    // Performs pending repairs of a relaxed tree, each one a single local step
+    // in its own small transaction, until none are left or maxSteps were done.
+    // Stops early when a whole pass over the slots only deferred entries, which
+    // then wait on work that concurrent updates still have to queue. Can run
+    // concurrently with updates, e.g. from a maintenance thread, but must not be
+    // called inside a transaction. Returns the number of repairs performed.
+    size_t rebalance(size_t maxSteps = SIZE_MAX)
+    {
+        size_t steps = 0;
+        bool progress = true;
+        while (progress && steps < maxSteps) {
+            progress = false;
+            int n = min(next_thread_id.load(), COUNTER_STRIPES);
+            for (int i = 0; i < n && steps < maxSteps; i++) {
+                if (repairStep(i) == REPAIRED) {
+                    steps++;
+                    progress = true;
+                }
+            }
+        }
+        return steps;
+    }
+
+    // same as deleteKey
+    bool erase(const K& n)
+    {
+        return deleteKey(n);
+    }
+
+    vector<K> inorder()
     {
-        vector<int> v;
+        vector<K> v;
         inorderHelp(root, v);
         return v;
     }
 
+    // Number of keys, O(threads) instead of a full walk
     size_t size()
     {
-        return sizeHelp(root);
+        return count.get();
+    }
+
+    // Non-transactional estimate of size(), never causes an abort
+    size_t sizeApprox()
+    {
+        return count.approx();
+    }
+
+    bool get(const K& key)
+    {
+        Node* n = lookup(key);
+        return n != NULL && !isDeleted(n);
+    }
+
+    iterator begin()
+    {
+        Node* r = LOAD_NODE(root);
+        return iterator(r == NULL ? NULL : successor(r), relaxed);
+    }
+
+    iterator end() { return iterator(NULL); }
+
+    // first key >= key
+    iterator lowerBound(const K& key)
+    {
+        Node* temp = LOAD_NODE(root);
+        Node* best = NULL;
+        while (temp != NULL) {
+            if (comp(LOAD_VALUE(temp->key), key)) {
+                temp = LOAD_NODE(temp->right);
+            } else {
+                best = temp;
+                temp = LOAD_NODE(temp->left);
+            }
+        }
+        return iterator(best, relaxed);
+    }
+
+    // calls f(key) on every key in [lo, hi] in ascending order
+    template <typename F>
+    void rangeScan(const K& lo, const K& hi, F f)
+    {
+        for (iterator it = lowerBound(lo); it != end(); ++it) {
+            K key = *it;
+            if (comp(hi, key))
+                break;
+            f(key);
+        }
     }
 
-    bool get(int key)
+    // number of keys in [lo, hi]
+    size_t rangeCount(const K& lo, const K& hi)
     {
-        return getHelp(LOAD_NODE(root), key);
+        size_t n = 0;
+        rangeScan(lo, hi, [&n](const K&) { n++; });
+        return n;
     }
 
     int maxHeight(){
@@ -0,0 +1,49 @@
+#ifndef RW_LOCK_TREE_HPP
+#define RW_LOCK_TREE_HPP
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <vector>
+
+// Baseline for the ordered sets without the STM, see bench --type rb-rwlock.
+// A red-black tree (std::set) behind one reader-writer lock, so gets run in
+// parallel and updates one at a time. Not for use inside transactions
+using namespace std;
+
+class RWLockTree {
+    set<int64_t> keys;
+    shared_mutex lock;
+
+public:
+    bool insert(int64_t n)
+    {
+        unique_lock<shared_mutex> guard(lock);
+        return keys.insert(n).second;
+    }
+
+    bool deleteKey(int64_t n)
+    {
+        unique_lock<shared_mutex> guard(lock);
+        return keys.erase(n) > 0;
+    }
+
+    bool get(int64_t key)
+    {
+        shared_lock<shared_mutex> guard(lock);
+        return keys.count(key) > 0;
+    }
+
+    vector<int64_t> inorder()
+    {
+        shared_lock<shared_mutex> guard(lock);
+        return vector<int64_t>(keys.begin(), keys.end());
+    }
+
+    size_t size()
+    {
+        shared_lock<shared_mutex> guard(lock);
+        return keys.size();
+    }
+};
+
+#endif
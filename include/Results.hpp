@@ -0,0 +1,197 @@
+#ifndef RESULTS_HPP
+#define RESULTS_HPP
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Benchmark results: one trial's numbers, JSON records and baseline comparison
+using namespace std;
+
+struct TrialResult {
+    double seconds;
+    int64_t ops;
+    double kops; // 1000x ops per second
+    bool hasLatency;
+    uint64_t p50, p99, p999, maxLatency; // ns
+    int64_t attempts; // transactions begun, counting retries
+    int64_t aborts;
+};
+
+inline double mean(const vector<double>& v)
+{
+    double sum = 0;
+    for (double x : v)
+        sum += x;
+    return v.empty() ? 0 : sum / v.size();
+}
+
+// sample variance
+inline double variance(const vector<double>& v)
+{
+    if (v.size() < 2)
+        return 0;
+    double m = mean(v), sum = 0;
+    for (double x : v)
+        sum += (x - m) * (x - m);
+    return sum / (v.size() - 1);
+}
+
+// Two sided 5% critical value of Student's t with df degrees of freedom
+inline double tCritical(double df)
+{
+    static const double table[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    int d = (int) df;
+    if (d < 1)
+        d = 1;
+    return d <= 30 ? table[d - 1] : 1.96;
+}
+
+// Welch's t-test of whether a and b have different means at the 5% level.
+// Needs at least 2 samples on each side, returns false otherwise
+inline bool significantlyDifferent(const vector<double>& a, const vector<double>& b)
+{
+    if (a.size() < 2 || b.size() < 2)
+        return false;
+    double va = variance(a) / a.size(), vb = variance(b) / b.size();
+    if (va + vb == 0)
+        return mean(a) != mean(b);
+    double t = (mean(a) - mean(b)) / sqrt(va + vb);
+    double df = (va + vb) * (va + vb) / (va * va / (a.size() - 1) + vb * vb / (b.size() - 1));
+    return fabs(t) > tCritical(df);
+}
+
+inline string jsonString(const string& s)
+{
+    string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char) c >= 0x20)
+            out += c;
+    }
+    return out + "\"";
+}
+
+template <typename T, typename F>
+string jsonArray(const vector<T>& trials, F field)
+{
+    ostringstream out;
+    out << "[";
+    for (size_t i = 0; i < trials.size(); i++)
+        out << (i ? ", " : "") << field(trials[i]);
+    out << "]";
+    return out.str();
+}
+
+// "trials" and "summary" members of a JSON record, the caller writes the rest
+inline string trialsJson(const vector<TrialResult>& trials)
+{
+    vector<double> kops, p99;
+    int64_t attempts = 0, aborts = 0;
+    for (const TrialResult& r : trials) {
+        kops.push_back(r.kops);
+        p99.push_back(r.p99);
+        attempts += r.attempts;
+        aborts += r.aborts;
+    }
+    bool latency = !trials.empty() && trials[0].hasLatency;
+    ostringstream out;
+    out << "\"trials\": {";
+    out << "\"throughput_kops\": " << jsonArray(trials, [](const TrialResult& r) { return r.kops; });
+    out << ", \"seconds\": " << jsonArray(trials, [](const TrialResult& r) { return r.seconds; });
+    out << ", \"ops\": " << jsonArray(trials, [](const TrialResult& r) { return r.ops; });
+    out << ", \"attempts\": " << jsonArray(trials, [](const TrialResult& r) { return r.attempts; });
+    out << ", \"aborts\": " << jsonArray(trials, [](const TrialResult& r) { return r.aborts; });
+    if (latency) {
+        out << ", \"p50_ns\": " << jsonArray(trials, [](const TrialResult& r) { return r.p50; });
+        out << ", \"p99_ns\": " << jsonArray(trials, [](const TrialResult& r) { return r.p99; });
+        out << ", \"p999_ns\": " << jsonArray(trials, [](const TrialResult& r) { return r.p999; });
+        out << ", \"max_ns\": " << jsonArray(trials, [](const TrialResult& r) { return r.maxLatency; });
+    }
+    out << "}, \"summary\": {";
+    out << "\"throughput_kops_mean\": " << mean(kops) << ", \"throughput_kops_stddev\": " << sqrt(variance(kops));
+    out << ", \"abort_rate\": " << (attempts ? (double) aborts / attempts : 0);
+    if (latency)
+        out << ", \"p99_ns_mean\": " << mean(p99);
+    out << "}";
+    return out.str();
+}
+
+// Reads the numbers of the array member named key out of a record written by
+// trialsJson. Returns false if there is no such member
+inline bool readJsonArray(const string& json, const string& key, vector<double>& out)
+{
+    out.clear();
+    size_t pos = json.find("\"" + key + "\"");
+    if (pos == string::npos)
+        return false;
+    size_t open = json.find('[', pos), close = json.find(']', pos);
+    if (open == string::npos || close == string::npos || close < open)
+        return false;
+    istringstream in(json.substr(open + 1, close - open - 1));
+    string item;
+    while (getline(in, item, ','))
+        out.push_back(stod(item));
+    return true;
+}
+
+/**
+ * @brief Compares trials against a baseline record written with --json
+ *
+ * Reports throughput and p99 latency changes, flagging them as regressions
+ * only when Welch's t-test finds the difference significant.
+ *
+ * @return false if there is a significant regression
+ */
+inline bool compareWithBaseline(const string& path, const vector<TrialResult>& trials, ostream& out)
+{
+    ifstream in(path);
+    if (!in) {
+        out << "could not read baseline " << path << endl;
+        return false;
+    }
+    stringstream buf;
+    buf << in.rdbuf();
+    string json = buf.str();
+
+    bool ok = true;
+    auto check = [&](const string& name, const string& key, vector<double> cur, bool higherIsBetter) {
+        vector<double> base;
+        if (!readJsonArray(json, key, base) || base.empty()) {
+            out << "\t" << name << ": not in baseline" << endl;
+            return;
+        }
+        double change = (mean(cur) - mean(base)) / mean(base) * 100;
+        bool worse = higherIsBetter ? change < 0 : change > 0;
+        bool significant = significantlyDifferent(base, cur);
+        out << "\t" << name << ": " << mean(base) << " -> " << mean(cur) << " (" << (change >= 0 ? "+" : "") << change << "%)";
+        if (base.size() < 2 || cur.size() < 2)
+            out << " need 2+ trials on both sides to test";
+        else if (!significant)
+            out << " not significant";
+        else if (worse)
+            out << " REGRESSION";
+        else
+            out << " improvement";
+        out << endl;
+        if (significant && worse)
+            ok = false;
+    };
+    vector<double> kops, p99;
+    for (const TrialResult& r : trials) {
+        kops.push_back(r.kops);
+        p99.push_back(r.p99);
+    }
+    out << "Compared with " << path << endl;
+    check("throughput kops", "throughput_kops", kops, true);
+    if (!trials.empty() && trials[0].hasLatency)
+        check("p99 latency ns", "p99_ns", p99, false);
+    return ok;
+}
+
+#endif
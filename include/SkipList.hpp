@@ -0,0 +1,221 @@
+#ifndef SKIP_LIST_HPP
+#define SKIP_LIST_HPP
+#include <iostream>
+#include <vector>
+#include <iterator>
+#include "stm.hpp"
+#include "TxCounter.hpp"
+
+// Skip list implementation based on https://en.wikipedia.org/wiki/Skip_list
+using namespace std;
+
+#define LOAD_SN(addr) ((SkipNode*) LOAD(addr))
+#define SKIP_LIST_MAX_LEVEL 32
+
+class SkipNode {
+public:
+    int64_t val;
+    int64_t level; // number of next pointers, fixed at creation
+    SkipNode* next[]; // sized by level, see SkipNode::bytes
+
+    SkipNode(int64_t val, int level)
+        : val(val)
+        , level(level)
+    {
+        for (int i = 0; i < level; i++)
+            next[i] = NULL;
+    }
+
+    static size_t bytes(int level)
+    {
+        return sizeof(SkipNode) + level * sizeof(SkipNode*);
+    }
+};
+
+// Ordered set with the same surface as RBTree. An update only writes the
+// next pointers of its predecessors on the levels the node spans (2 on
+// average), so updates to different keys rarely conflict, unlike rotations.
+class SkipList {
+    SkipNode* head; // sentinel spanning every level
+    int64_t height; // highest level in use, only ever grows
+    TxCounter count;
+
+    // geometric level with p = 1/2, thread private so it never conflicts
+    static int randomLevel()
+    {
+        static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL * (_my_thread.id + 1);
+        // xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int level = 1;
+        uint64_t bits = state;
+        while ((bits & 1) && level < SKIP_LIST_MAX_LEVEL) {
+            level++;
+            bits >>= 1;
+        }
+        return level;
+    }
+
+    // fills preds[i] with the last node on level i whose key is < key, for
+    // every level below height. Returns the first node with key >= key
+    SkipNode* findPreds(int64_t key, SkipNode** preds)
+    {
+        SkipNode* x = head;
+        for (int i = LOAD(height) - 1; i >= 0; i--) {
+            SkipNode* next = LOAD_SN(x->next[i]);
+            while (next != NULL && LOAD(next->val) < key) {
+                x = next;
+                next = LOAD_SN(x->next[i]);
+            }
+            preds[i] = x;
+        }
+        return LOAD_SN(x->next[0]);
+    }
+
+public:
+    // Forward iterator in key order along the bottom level. Same rules as
+    // RBTree::iterator: must not be used across transactions.
+    class iterator {
+        SkipNode* node;
+
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = int64_t;
+        using difference_type = ptrdiff_t;
+        using pointer = const int64_t*;
+        // keys are read through LOAD, so dereferencing yields a copy
+        using reference = int64_t;
+
+        iterator() : node(NULL) {}
+        explicit iterator(SkipNode* node) : node(node) {}
+
+        int64_t operator*() const { return LOAD(node->val); }
+
+        iterator& operator++()
+        {
+            node = LOAD_SN(node->next[0]);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator old = *this;
+            ++(*this);
+            return old;
+        }
+
+        bool operator==(const iterator& other) const { return node == other.node; }
+        bool operator!=(const iterator& other) const { return node != other.node; }
+    };
+
+    SkipList()
+        : height(1)
+    {
+        head = new (malloc(SkipNode::bytes(SKIP_LIST_MAX_LEVEL))) SkipNode(0, SKIP_LIST_MAX_LEVEL);
+    }
+
+    // inserts the given value
+    // returns false if the value was already present
+    bool insert(int64_t n)
+    {
+        SkipNode* preds[SKIP_LIST_MAX_LEVEL];
+        SkipNode* x = findPreds(n, preds);
+        if (x != NULL && LOAD(x->val) == n)
+            return false;
+
+        int level = randomLevel();
+        int64_t oldHeight = LOAD(height);
+        if (level > oldHeight) {
+            for (int i = oldHeight; i < level; i++)
+                preds[i] = head;
+            STORE(height, level);
+        }
+
+        void* newNodeMem = MALLOC(SkipNode::bytes(level));
+        SkipNode* newNode = new (newNodeMem) SkipNode(n, level);
+        for (int i = 0; i < level; i++) {
+            // the new node is still private, only the predecessors are shared
+            newNode->next[i] = LOAD_SN(preds[i]->next[i]);
+            STORE(preds[i]->next[i], newNode);
+        }
+        count.increment();
+        return true;
+    }
+
+    // deletes the given value, returns false if it was not present
+    bool deleteKey(int64_t n)
+    {
+        SkipNode* preds[SKIP_LIST_MAX_LEVEL];
+        SkipNode* x = findPreds(n, preds);
+        if (x == NULL || LOAD(x->val) != n)
+            return false;
+
+        int level = LOAD(x->level);
+        for (int i = 0; i < level; i++)
+            STORE(preds[i]->next[i], LOAD_SN(x->next[i]));
+        FREE(x);
+        count.decrement();
+        return true;
+    }
+
+    bool get(int64_t key)
+    {
+        SkipNode* preds[SKIP_LIST_MAX_LEVEL];
+        SkipNode* x = findPreds(key, preds);
+        return x != NULL && LOAD(x->val) == key;
+    }
+
+    vector<int64_t> inorder()
+    {
+        vector<int64_t> v;
+        for (iterator it = begin(); it != end(); ++it)
+            v.push_back(*it);
+        return v;
+    }
+
+    // Number of keys, O(threads) instead of a full walk
+    size_t size()
+    {
+        return count.get();
+    }
+
+    // Non-transactional estimate of size(), never causes an abort
+    size_t sizeApprox()
+    {
+        return count.approx();
+    }
+
+    iterator begin() { return iterator(LOAD_SN(head->next[0])); }
+
+    iterator end() { return iterator(NULL); }
+
+    // first key >= key
+    iterator lowerBound(int64_t key)
+    {
+        SkipNode* preds[SKIP_LIST_MAX_LEVEL];
+        return iterator(findPreds(key, preds));
+    }
+
+    // calls f(key) on every key in [lo, hi] in ascending order
+    template <typename F>
+    void rangeScan(int64_t lo, int64_t hi, F f)
+    {
+        for (iterator it = lowerBound(lo); it != end(); ++it) {
+            int64_t key = *it;
+            if (key > hi)
+                break;
+            f(key);
+        }
+    }
+
+    // number of keys in [lo, hi]
+    size_t rangeCount(int64_t lo, int64_t hi)
+    {
+        size_t n = 0;
+        rangeScan(lo, hi, [&n](int64_t) { n++; });
+        return n;
+    }
+};
+
+#endif
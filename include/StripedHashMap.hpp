@@ -0,0 +1,113 @@
+#ifndef STRIPED_HASH_MAP_HPP
+#define STRIPED_HASH_MAP_HPP
+#include <memory>
+#include <mutex>
+#include "TxCounter.hpp"
+
+// Baseline for HashMap without the STM, see bench --type hash-striped.
+// Chained buckets like HashMap, bucket i is guarded by lock stripe
+// i % HASH_LOCK_STRIPES. Not for use inside transactions
+using namespace std;
+
+#define HASH_LOCK_STRIPES 1024
+
+class StripedHashMap {
+    struct Node {
+        int64_t key;
+        int64_t value;
+        Node* next;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Stripe {
+        mutex lock;
+        int64_t count; // keys in the stripe's buckets
+    };
+
+    Node** table;
+    int table_size;
+    unique_ptr<Stripe[]> stripes;
+
+    Stripe& stripeOf(unsigned long hashValue)
+    {
+        return stripes[hashValue % HASH_LOCK_STRIPES];
+    }
+
+public:
+    StripedHashMap(int table_size)
+        : table(new Node*[table_size]())
+        , table_size(table_size)
+        , stripes(new Stripe[HASH_LOCK_STRIPES]())
+    {
+    }
+
+    ~StripedHashMap()
+    {
+        for (int i = 0; i < table_size; i++) {
+            Node* entry = table[i];
+            while (entry != NULL) {
+                Node* next = entry->next;
+                delete entry;
+                entry = next;
+            }
+        }
+        delete[] table;
+    }
+
+    bool get(const int64_t& key, int64_t& value)
+    {
+        unsigned long hashValue = key % table_size;
+        lock_guard<mutex> guard(stripeOf(hashValue).lock);
+        for (Node* entry = table[hashValue]; entry != NULL; entry = entry->next) {
+            if (entry->key == key) {
+                value = entry->value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void put(const int64_t key, const int64_t value)
+    {
+        unsigned long hashValue = key % table_size;
+        Stripe& stripe = stripeOf(hashValue);
+        lock_guard<mutex> guard(stripe.lock);
+        Node** link = &table[hashValue];
+        while (*link != NULL && (*link)->key != key)
+            link = &(*link)->next;
+        if (*link == NULL) {
+            *link = new Node { key, value, NULL };
+            stripe.count++;
+        } else {
+            (*link)->value = value;
+        }
+    }
+
+    void remove(const int64_t& key)
+    {
+        unsigned long hashValue = key % table_size;
+        Stripe& stripe = stripeOf(hashValue);
+        lock_guard<mutex> guard(stripe.lock);
+        Node** link = &table[hashValue];
+        while (*link != NULL && (*link)->key != key)
+            link = &(*link)->next;
+        if (*link != NULL) {
+            Node* entry = *link;
+            *link = entry->next;
+            delete entry;
+            stripe.count--;
+        }
+    }
+
+    // Number of keys, exact once concurrent updates are done
+    size_t size()
+    {
+        int64_t total = 0;
+        for (int i = 0; i < HASH_LOCK_STRIPES; i++) {
+            lock_guard<mutex> guard(stripes[i].lock);
+            total += stripes[i].count;
+        }
+        return total;
+    }
+};
+
+#endif
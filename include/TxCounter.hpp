@@ -0,0 +1,62 @@
+#ifndef TX_COUNTER_HPP
+#define TX_COUNTER_HPP
+#include <algorithm>
+#include "stm.hpp"
+
+#define CACHE_LINE_SIZE 64
+#define COUNTER_STRIPES 64
+
+// Striped counter that transactions can update without conflicting with each other.
+// Every thread adds into its own cache line sized slot (picked by TxThread::id).
+// Ids are recycled lowest first, so two writers only share a stripe when more than
+// COUNTER_STRIPES threads are alive at once.
+class TxCounter {
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        int64_t value;
+    };
+    Slot slots[COUNTER_STRIPES];
+
+    // Only slots that some thread has been assigned to can be non-zero
+    int usedSlots()
+    {
+        return min(next_thread_id.load(), COUNTER_STRIPES);
+    }
+
+public:
+    TxCounter() : slots{} {}
+
+    void add(int64_t delta)
+    {
+        Slot& slot = slots[_my_thread.id % COUNTER_STRIPES];
+        STORE(slot.value, LOAD(slot.value) + delta);
+    }
+
+    void increment() { add(1); }
+    void decrement() { add(-1); }
+
+    // Exact value. Inside a transaction every used slot ends up in the read set,
+    // so this conflicts with any concurrent add()
+    int64_t get()
+    {
+        int64_t total = 0;
+        int n = usedSlots();
+        for (int i = 0; i < n; i++) {
+            total += LOAD(slots[i].value);
+        }
+        return total;
+    }
+
+    // Approximate value, never instrumented and never aborts. Commits that are
+    // in the middle of write back may be partially observed
+    int64_t approx()
+    {
+        int64_t total = 0;
+        int n = usedSlots();
+        for (int i = 0; i < n; i++) {
+            total += __atomic_load_n(&slots[i].value, __ATOMIC_RELAXED);
+        }
+        return total;
+    }
+};
+
+#endif
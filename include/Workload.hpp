@@ -0,0 +1,182 @@
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Benchmark workloads: which keys are touched and how often each op runs
+using namespace std;
+
+enum OperationType { PUT, DELETE, GET };
+typedef struct Operation {
+    OperationType op_type;
+    int64_t key;
+} Operation;
+
+enum KeyDistribution { UNIFORM, ZIPF, HOTSPOT, SEQUENTIAL };
+
+struct Workload {
+    int64_t numOps = 3000000;
+    // keys are drawn from [keyMin, keyMax)
+    int64_t keyMin = 10000;
+    int64_t keyMax = 20000;
+    KeyDistribution dist = UNIFORM;
+    // zipf exponent theta in [0, 1), the larger the more skewed
+    double skew = 0.99;
+    // hotspot: hotProb of the ops go to the first hotFraction of the keys
+    double hotFraction = 0.2;
+    double hotProb = 0.8;
+    // op mix, fractions that add up to 1
+    double puts = 0.3;
+    double deletes = 0.3;
+    double gets = 0.4;
+    // fraction of the key range inserted before timing starts
+    double prepopulate = 0;
+    uint64_t seed = 0;
+};
+
+// Draws keys from a Workload's distribution. Zipf ranks follow Gray et al.,
+// "Quickly generating billion-record synthetic databases": the zeta sum is
+// computed once per generator, then every key is O(1). Rank 0, the hottest
+// key, is keyMin.
+class KeyGenerator {
+    Workload w;
+    int64_t range;
+    mt19937_64 rng;
+    uniform_real_distribution<double> unit;
+    int64_t nextSeq;
+    double zetan, alpha, eta;
+
+    static double zeta(int64_t n, double theta)
+    {
+        double sum = 0;
+        for (int64_t i = 1; i <= n; i++)
+            sum += 1.0 / pow((double) i, theta);
+        return sum;
+    }
+
+    int64_t zipfRank()
+    {
+        double u = unit(rng);
+        double uz = u * zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + pow(0.5, w.skew))
+            return 1;
+        return min(range - 1, (int64_t) (range * pow(eta * u - eta + 1, alpha)));
+    }
+
+public:
+    // seqStart: offset of the first key of a sequential stream
+    KeyGenerator(const Workload& w, uint64_t seed, int64_t seqStart = 0)
+        : w(w)
+        , range(max<int64_t>(1, w.keyMax - w.keyMin))
+        , rng(seed)
+        , unit(0.0, 1.0)
+        , nextSeq(seqStart)
+        , zetan(0)
+        , alpha(0)
+        , eta(0)
+    {
+        if (w.dist == ZIPF) {
+            zetan = zeta(range, w.skew);
+            alpha = 1.0 / (1.0 - w.skew);
+            eta = (1 - pow(2.0 / range, 1 - w.skew)) / (1 - zeta(2, w.skew) / zetan);
+        }
+    }
+
+    int64_t next()
+    {
+        switch (w.dist) {
+        case ZIPF:
+            return w.keyMin + zipfRank();
+        case HOTSPOT: {
+            int64_t hot = max<int64_t>(1, range * w.hotFraction);
+            if (unit(rng) < w.hotProb || hot == range)
+                return w.keyMin + rng() % hot;
+            return w.keyMin + hot + rng() % (range - hot);
+        }
+        case SEQUENTIAL:
+            return w.keyMin + nextSeq++ % range;
+        default:
+            return w.keyMin + rng() % range;
+        }
+    }
+
+    OperationType nextOp()
+    {
+        double type = unit(rng);
+        if (type < w.puts)
+            return PUT;
+        if (type < w.puts + w.deletes)
+            return DELETE;
+        return GET;
+    }
+};
+
+// Parses a distribution name, returns false if it is not one of
+// uniform, zipf, hotspot, sequential
+inline bool parseDistribution(const string& name, KeyDistribution& dist)
+{
+    if (name == "uniform")
+        dist = UNIFORM;
+    else if (name == "zipf")
+        dist = ZIPF;
+    else if (name == "hotspot")
+        dist = HOTSPOT;
+    else if (name == "sequential")
+        dist = SEQUENTIAL;
+    else
+        return false;
+    return true;
+}
+
+// Parses "puts,deletes,gets" weights (e.g. "30,30,40") into the op mix of w,
+// returns false if malformed
+inline bool parseMix(const string& mix, Workload& w)
+{
+    double p, d, g;
+    char c1, c2;
+    istringstream in(mix);
+    if (!(in >> p >> c1 >> d >> c2 >> g) || c1 != ',' || c2 != ',' || p < 0 || d < 0 || g < 0 || p + d + g <= 0)
+        return false;
+    w.puts = p / (p + d + g);
+    w.deletes = d / (p + d + g);
+    w.gets = g / (p + d + g);
+    return true;
+}
+
+// Operation stream of thread_id out of numThreads, which together run
+// w.numOps transactions of txSize ops each. Every thread has its own generator, so the streams can be
+// built in parallel on the threads that run them. Sequential streams start
+// at evenly spread keys
+inline vector<Operation> generateThreadOps(const Workload& w, int thread_id, int numThreads, int txSize = 1)
+{
+    int64_t n = (w.numOps / numThreads + (thread_id < w.numOps % numThreads)) * txSize;
+    int64_t range = max<int64_t>(1, w.keyMax - w.keyMin);
+    KeyGenerator gen(w, w.seed * numThreads + thread_id, range / numThreads * thread_id);
+    vector<Operation> ops;
+    ops.reserve(n);
+    for (int64_t i = 0; i < n; i++) {
+        OperationType type = gen.nextOp();
+        ops.push_back(Operation { type, gen.next() });
+    }
+    return ops;
+}
+
+// Keys to insert before timing, each key of the range with probability w.prepopulate
+inline vector<int64_t> prepopulateKeys(const Workload& w)
+{
+    mt19937_64 rng(w.seed + 1);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    vector<int64_t> keys;
+    for (int64_t k = w.keyMin; k < w.keyMax; k++) {
+        if (unit(rng) < w.prepopulate)
+            keys.push_back(k);
+    }
+    return keys;
+}
+
+#endif
@@ -9,6 +9,10 @@
 #include <assert.h>
 #include <iostream>
 #include <thread>
+#include <cstring>
+#include <type_traits>
+#include <algorithm>
+#include <string>
 
 #include <ankerl/unordered_dense.h>
 #include <boost/container/small_vector.hpp>
@@ -20,47 +24,152 @@ inline static atomic<int64_t> global_version_clock { 0 };
 // Global lock for testing
 inline mutex global_lock;
 inline bool debug{false};
+// Source of TxThread::id. Ids of exited threads are reused (lowest first), so
+// next_thread_id is the high-water mark of ids handed out so far
+inline atomic<int> next_thread_id { 0 };
+inline mutex thread_id_lock;
+inline vector<int> free_thread_ids;
 
+// Versioned write lock in one word: the version shifted left by one, and
+// the low bit set while the lock is held. All zero is an unlocked lock at
+// version 0, so the lock table can start out as zeroed pages
 class VersionedLock {
+    atomic<int64_t> word;
+
 public:
-    int64_t version;
-    mutex lock;
-    bool locked;
+    VersionedLock() : word{0} {}
+
+    // The version and lock bit as of one load, see versionOf and lockedIn
+    int64_t sample() const { return word.load(memory_order_acquire); }
+    static int64_t versionOf(int64_t sample) { return sample >> 1; }
+    static bool lockedIn(int64_t sample) { return sample & 1; }
 
-    VersionedLock() : version{0}, lock{}, locked{false} {}
+    int64_t version() const { return versionOf(sample()); }
+    bool isLocked() const { return lockedIn(sample()); }
 
     bool tryLock(){
-        bool res = lock.try_lock();
-        if(res){
-            // Acquired lock
-            locked = true; 
-            //!!       I think it might be really important this "locked" is at the end here.
-            //!!       There are assertions sprinkled around that check isLocked() and check 
-            //!!       conditions about the above fields. If the fields are changed after locked,
-            //!!       then an assertion can see the lock is held, but get incorrect information
-            //!!       about the lock holder.
-        }
-        return res;
+        int64_t w = word.load(memory_order_relaxed);
+        return !lockedIn(w) && word.compare_exchange_strong(w, w | 1, memory_order_acquire);
     }
 
     void unlock(int64_t new_version){
-        version = new_version;
         // Version is advanced every successful lock release
-        locked = false;
-        lock.unlock();
+        word.store(new_version << 1, memory_order_release);
     }
 
     void abortUnlock(){
         // Used by abort to unlock this lock without changing the version
-        locked = false;
-        lock.unlock();
+        word.store(word.load(memory_order_relaxed) & ~1, memory_order_release);
     }
 };
 
-// Per stripe lock array - basically just a hash map
+// Per stripe lock array - basically just a hash map. It is mapped by the
+// first TxThread (see mapLockTable), so GET_LOCK is only valid on a thread
+// that has touched _my_thread
 #define NUM_LOCKS (2 << 20)
-inline VersionedLock PSLocks[NUM_LOCKS];
-#define GET_LOCK(addr) (PSLocks[(((uint64_t) addr & 0x3FFFFC) + (uint64_t) addr) % NUM_LOCKS])
+inline VersionedLock* PSLocks = nullptr;
+#define GET_LOCK(addr) (PSLocks[(((uint64_t) (addr) & 0x3FFFFC) + (uint64_t) (addr)) % NUM_LOCKS])
+void mapLockTable();
+// Pages backing the lock table: "hugetlb", "thp", "4k", or "unmapped"
+const char* lockTablePages();
+
+// Write sets larger than this give their memory back at the end of the transaction
+#define WRITE_MAP_KEEP 256
+
+// Outcome of the non-jumping operations (txTryLoad and friends)
+enum TxStatus {
+    TX_OK,
+    TX_BUSY, // a stripe is locked by another commit, retrying later may work
+    TX_CONFLICT // the transaction must be rolled back and run again
+};
+
+// Profile of one transaction call site, see TxBegin("name"). Counts are
+// striped by thread id like TxCounter, so recording them writes no shared
+// cache line (two threads only share a stripe past TX_SITE_STRIPES live
+// threads, then an update may get lost). Every TX_SITE_ADAPT_PERIOD commits
+// in a stripe, adapt() recomputes the site's policy from the attempts since
+// its last run:
+// - above TX_SITE_BACKOFF_RATE aborts per attempt, its transactions back off
+//   after aborts like BackoffPolicy
+// - above TX_SITE_THROTTLE_RATE at most half as many of them run at once as
+//   before, starting from the threads seen at the site. Below
+//   TX_SITE_BACKOFF_RATE the limit doubles, until it is lifted
+// - a transaction that retried serialAfter() times runs serially: it waits
+//   for every other transaction in the process to end and keeps new ones
+//   from starting until it commits. Sites above TX_SITE_THROTTLE_RATE switch
+//   after TX_SITE_SERIAL_EARLY retries instead of TX_SITE_SERIAL_AFTER
+// A site also learns whether its transactions write: until one commits a
+// write, they start read only (no read set), after that read-write (no
+// restart at the first store). This takes the place of the TxBeginReadOnly
+// hint and of optimisticReadOnly for named transactions
+#define TX_SITE_STRIPES 64
+#define TX_SITE_ADAPT_PERIOD 256
+#define TX_SITE_BACKOFF_RATE 0.5
+#define TX_SITE_THROTTLE_RATE 0.8
+#define TX_SITE_SERIAL_AFTER 32
+#define TX_SITE_SERIAL_EARLY 8
+class TxSite {
+public:
+    struct Counts {
+        int64_t commits = 0;
+        int64_t aborts = 0;
+        int64_t readWords = 0; // read set sizes at commit, 0 for read only transactions
+        int64_t writeWords = 0; // write set sizes at commit
+        int64_t serial = 0; // commits that ran serially
+        int64_t maxRetries = 0;
+    };
+
+    const string name;
+
+    explicit TxSite(const string& name) : name(name), stripes{} {}
+
+    // Summed over the stripes, exact once the site's transactions are done
+    Counts counts() const;
+
+    bool backoff() const { return backoffOn.load(memory_order_relaxed); }
+    // Transactions of the site that may run at once, 0 for no limit
+    int limit() const { return concurrency.load(memory_order_relaxed); }
+    int serialAfter() const { return serialRetries.load(memory_order_relaxed); }
+    // Some transaction of the site committed a write or an allocation
+    bool wrote() const { return wroteOnce.load(memory_order_relaxed); }
+
+    // Sets the policy and stops adapting it
+    void fix(bool backoff, int limit, int serialAfter);
+
+private:
+    friend class TxThread;
+
+    struct alignas(64) Stripe {
+        atomic<int64_t> commits, aborts, readWords, writeWords, serial, maxRetries;
+        // commits and aborts when adapt() last ran
+        int64_t adaptedCommits, adaptedAborts;
+    };
+    Stripe stripes[TX_SITE_STRIPES];
+    atomic<bool> backoffOn { false };
+    atomic<int> concurrency { 0 };
+    atomic<int> serialRetries { TX_SITE_SERIAL_AFTER };
+    atomic<int> running { 0 }; // admitted transactions, while there is a limit
+    atomic<bool> adapting { false };
+    atomic<bool> fixed { false };
+    atomic<bool> wroteOnce { false };
+
+    // Only the thread owning the stripe adds to it
+    static void add(atomic<int64_t>& count, int64_t delta)
+    {
+        count.store(count.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+
+    void adapt();
+};
+
+// The site registered under name, created on first use. Sites live until the
+// process exits
+TxSite* txSite(const char* name);
+// One line per site, in order of registration: commits, aborts, the abort
+// rate, aborts per commit, the most retries of one transaction, read and
+// write set words per commit, serial commits, the current policy and whether
+// the site starts read only
+void txDumpSites(ostream& out);
 
 class TxThread {
     int64_t rv;
@@ -74,33 +183,106 @@ class TxThread {
 
     
     void txCommit();
+    void clearWriteMap();
+    void releaseLocks();
+    void scheduleBegin();
+    void scheduleEnd(bool committed);
+    void blameConflict();
+    void beginEpoch();
+    void endEpoch();
+    void enterSerial();
+    void leaveSerial();
+    void siteCommitted();
     
 public:
     TxThread();
+    ~TxThread();
 
     void txBegin();
     void txEnd();
+    // Once per transaction, before its first txBegin (see StmPolicyOps::prepare).
+    // Waits until the site admits another transaction if it has a limit
+    void enterSite(TxSite* s);
+    // See txEnterExclusive, outside of any transaction
+    void enterExclusive();
+    void leaveExclusive();
 
     intptr_t txLoad(intptr_t* addr);
     void txStore(intptr_t* addr, intptr_t val);
 
     void* txMalloc(size_t);
+    void* txMallocAligned(size_t alignment, size_t size);
     void txFree(void* p);
 
+    // Bulk copies of [src, src + bytes) into or out of shared memory, and
+    // between two shared ranges. Neither end needs to be word aligned
+    void txLoadRange(void* dst, const void* src, size_t bytes);
+    void txStoreRange(void* dst, const void* src, size_t bytes);
+    void txMemcpy(void* dst, const void* src, size_t bytes);
+    void txMemset(void* dst, int c, size_t bytes);
+
+    void txRelease(intptr_t* addr);
+    size_t readSetSize() const { return read_set.size(); }
+
+    // The same operations, reporting instead of jumping back to TxBegin, for
+    // callers that cannot longjmp such as coroutines (see CoTx.hpp). After
+    // TX_BUSY nothing changed and the operation can be retried, after
+    // TX_CONFLICT the caller has to txRollback. A busy txTryCommit lets go
+    // of the locks it took
+    TxStatus txTryLoad(intptr_t* addr, intptr_t& value);
+    TxStatus txTryStore(intptr_t* addr, intptr_t val);
+    TxStatus txTryCommit();
+    void txRollback();
+
     bool inReadSet(uint64_t);
     void txAbort();
+    // Adds this thread's counts to the totals txShutdown prints and resets them
+    void txRetire();
 
     jmp_buf jump_buffer;
+    int id; // Index unique among live threads, recycled on exit, used to pick per-thread stripes
     bool inTx; // Currently no nesting
     // Profiling
-    int txCount;
+    int txCount; // transactions begun, counting every retry
+    int64_t numAborts;
     int numLoads;
     int numStores;
     bool read_only;
+    bool backoff; // back off after an abort, set per transaction by its policy
     useconds_t delay;
+    // Conflict scheduling, see SchedulerPolicy
+    bool schedule; // set per transaction by its policy
+    VersionedLock* conflict_lock; // stripe of the last TX_BUSY or TX_CONFLICT
+    int enemy; // thread that last locked the stripes of recent aborts, -1 if none
+    int strikes; // recent aborts caused by enemy, less one per commit
+    // Call site profile, see TxSite
+    TxSite* site; // NULL for unnamed transactions
+    int siteStart; // txCount before the first attempt
+    bool admitted; // holds one of the site's running slots
+    bool serial; // runs alone in the process until it commits
+    // Waits for serial transactions and is waited for by them. Off for
+    // descriptors that may be suspended inside a transaction (CoTx), which
+    // commit validation alone keeps correct next to a serial one
+    bool quiesce;
+    bool exclusive; // between txEnterExclusive and txLeaveExclusive
 };
 
 
+// Once per process, around all transactional work (STM_STARTUP/STM_SHUTDOWN)
+void txStartup();
+void txShutdown();
+
+// Exclusive mode for single threaded phases, e.g. filling a data structure
+// before the workers start. txEnterExclusive waits for the transactions of
+// other threads to end and holds back new ones until txLeaveExclusive, like
+// a serial transaction. In between, TxBegin/TxEnd of the calling thread do
+// nothing, so LOAD, STORE, MALLOC and FREE go straight to memory and no
+// stripe is locked. Lock versions need no update: every transaction that
+// can see the writes starts after them. CoTx transactions are not waited
+// for, none may be in flight. Call outside of any transaction
+void txEnterExclusive();
+void txLeaveExclusive();
+
 // Using thread local storage for some magic here - every thread automatically
 // gets this _my_thread transactional context
 inline thread_local TxThread _my_thread;
@@ -110,25 +292,227 @@ inline thread_local TxThread _my_thread;
 #define LOAD(var) (_my_thread.txLoad((intptr_t*)&var))
 #define STORE(var, val) (_my_thread.txStore((intptr_t*)&var, (intptr_t)val))
 #define MALLOC(size) (_my_thread.txMalloc(size))
+#define MALLOC_ALIGNED(alignment, size) (_my_thread.txMallocAligned(alignment, size))
 #define FREE(ptr) (_my_thread.txFree(ptr))
+#define RELEASE(var) (_my_thread.txRelease((intptr_t*)&var))
+// dst and src as in memcpy. LOAD_RANGE reads shared src, STORE_RANGE writes
+// shared dst, MEMCPY and MEMSET work on shared memory only
+#define LOAD_RANGE(dst, src, bytes) (_my_thread.txLoadRange(dst, src, bytes))
+#define STORE_RANGE(dst, src, bytes) (_my_thread.txStoreRange(dst, src, bytes))
+#define MEMCPY(dst, src, bytes) (_my_thread.txMemcpy(dst, src, bytes))
+#define MEMSET(dst, c, bytes) (_my_thread.txMemset(dst, c, bytes))
 // #define FREE(ptr) ({})
 #else
 #define LOAD(var) (var)
 #define STORE(var, val) (var = val)
 #define MALLOC(size) (malloc(size))
+#define MALLOC_ALIGNED(alignment, size) (aligned_alloc(alignment, size))
 #define FREE(ptr) (free(ptr))
+#define RELEASE(var) ((void) &(var))
+#define LOAD_RANGE(dst, src, bytes) (memcpy(dst, src, bytes))
+#define STORE_RANGE(dst, src, bytes) (memcpy(dst, src, bytes))
+#define MEMCPY(dst, src, bytes) (memmove(dst, src, bytes))
+#define MEMSET(dst, c, bytes) (memset(dst, c, bytes))
 #endif
 
-#ifdef OPTIMISTIC_READ_ONLY // Optimistically assume that everything is read only until we get to a store
-    #define TxBegin() _my_thread.read_only = true; setjmp(_my_thread.jump_buffer); _my_thread.txBegin();
+// LOAD/STORE for any trivially copyable type, e.g. templated keys and values.
+// A value that is not one aligned word goes through txLoadRange/txStoreRange
+// over the aligned words it overlaps. A word it only partly covers is read
+// whole, and a store writes it back with the neighbouring bytes unchanged, so
+// a value smaller than a word conflicts like its whole word.
+// The overloads taking a TxThread& skip the thread local lookup (see stm.h)
+#define LOAD_VALUE(var) (txLoadValue(var))
+#define STORE_VALUE(var, val) (txStoreValue(var, val))
+#define RELEASE_VALUE(var) (txReleaseValue(var))
+
+template <typename T>
+inline T txLoadValue(TxThread& t, const T& var)
+{
+    static_assert(is_trivially_copyable<T>::value, "only trivially copyable values can be loaded word by word");
+#ifdef USE_STM
+    if constexpr (sizeof(T) == sizeof(intptr_t) && alignof(T) >= alignof(intptr_t)) {
+        intptr_t word = t.txLoad((intptr_t*) &var);
+        T value;
+        memcpy(&value, &word, sizeof(T));
+        return value;
+    } else {
+        T value {}; // every byte is overwritten below, but the compiler cannot tell
+        t.txLoadRange(&value, &var, sizeof(T));
+        return value;
+    }
 #else
-    #define TxBegin() _my_thread.read_only = false; setjmp(_my_thread.jump_buffer); _my_thread.txBegin();
+    return var;
+#endif
+}
+
+template <typename T>
+inline void txStoreValue(TxThread& t, T& var, const T& val)
+{
+    static_assert(is_trivially_copyable<T>::value, "only trivially copyable values can be stored word by word");
+#ifdef USE_STM
+    if constexpr (sizeof(T) == sizeof(intptr_t) && alignof(T) >= alignof(intptr_t)) {
+        intptr_t word;
+        memcpy(&word, &val, sizeof(T));
+        t.txStore((intptr_t*) &var, word);
+    } else {
+        t.txStoreRange(&var, &val, sizeof(T));
+    }
+#else
+    var = val;
+#endif
+}
+
+template <typename T>
+inline void txReleaseValue(TxThread& t, const T& var)
+{
+#ifdef USE_STM
+    uintptr_t begin = (uintptr_t) &var;
+    for (uintptr_t w = begin & ~(sizeof(intptr_t) - 1); w < begin + sizeof(T); w += sizeof(intptr_t))
+        t.txRelease((intptr_t*) w);
+#endif
+}
+
+template <typename T>
+inline T txLoadValue(const T& var)
+{
+    return txLoadValue(_my_thread, var);
+}
+
+template <typename T>
+inline void txStoreValue(T& var, const T& val)
+{
+    txStoreValue(_my_thread, var, val);
+}
+
+template <typename T>
+inline void txReleaseValue(const T& var)
+{
+    txReleaseValue(_my_thread, var);
+}
+
+// STM variants as policies, so one binary can run several of them (see
+// bench --stm). A policy only decides how a transaction begins, ends and
+// backs off, which TxBeginP/TxEndP resolve at compile time. Loads and
+// stores are the same code for every variant.
+struct Tl2Policy {
+    static constexpr const char* name = "tl2";
+    // TxBegin starts read only and restarts as read-write at the first write
+    static constexpr bool optimisticReadOnly = false;
+    // TxBeginReadOnly runs as a read only transaction, else like TxBegin
+    static constexpr bool readOnlyTx = true;
+    // exponential backoff after an abort
+    static constexpr bool backoff = false;
+    // wait for the thread behind recent aborts, see SchedulerPolicy
+    static constexpr bool schedule = false;
+    // no STM: one global mutex around every transaction, loads and stores go
+    // straight to memory since the thread is never inTx
+    static constexpr bool globalLock = false;
+};
+
+struct OptimisticReadOnlyPolicy : Tl2Policy {
+    static constexpr const char* name = "optimistic-ro";
+    static constexpr bool optimisticReadOnly = true;
+};
+
+struct NoReadOnlyPolicy : Tl2Policy {
+    static constexpr const char* name = "no-ro";
+    static constexpr bool readOnlyTx = false;
+};
+
+struct BackoffPolicy : Tl2Policy {
+    static constexpr const char* name = "backoff";
+    static constexpr bool backoff = true;
+};
+
+// Learns which thread keeps aborting this one: commits record who locked
+// each stripe, and an abort blames whoever last locked the stripe it failed
+// on. Once the same thread caused SCHED_STRIKES recent aborts, every attempt
+// first waits for that thread's running transaction to end, so the pair runs
+// one after the other instead of aborting each other. Strikes wear off by one
+// per commit
+#define SCHED_STRIKES 2
+struct SchedulerPolicy : Tl2Policy {
+    static constexpr const char* name = "sched";
+    static constexpr bool schedule = true;
+};
+
+struct GlobalLockPolicy : Tl2Policy {
+    static constexpr const char* name = "global-lock";
+    static constexpr bool globalLock = true;
+};
+
+// The variant picked by the build flags, used by TxBegin/TxEnd
+struct DefaultStmPolicy : Tl2Policy {
+    static constexpr const char* name = "default";
+#ifdef OPTIMISTIC_READ_ONLY // Optimistically assume that everything is read only until we get to a store
+    static constexpr bool optimisticReadOnly = true;
+#endif
+#ifdef NO_RO_TX // Disable read only transactions entirely
+    static constexpr bool readOnlyTx = false;
+#endif
+#ifdef USE_BACKOFF
+    static constexpr bool backoff = true;
 #endif
-#define TxEnd() (_my_thread.txEnd())
-    #ifdef NO_RO_TX // Disable read only transactions entirely
-    #define TxBeginReadOnly() TxBegin()
-    #else
-    #define TxBeginReadOnly() _my_thread.read_only = true; setjmp(_my_thread.jump_buffer); _my_thread.txBegin();
-    #endif
+#ifdef USE_SCHEDULER
+    static constexpr bool schedule = true;
+#endif
+};
+
+template <typename Policy>
+struct StmPolicyOps {
+    // Runs once per transaction, before the setjmp that retries return to
+    static void prepare(TxThread& t, bool readOnly, TxSite* site = NULL)
+    {
+        t.read_only = !Policy::globalLock && (readOnly && Policy::readOnlyTx ? true : Policy::optimisticReadOnly);
+        t.backoff = Policy::backoff;
+        t.delay = 1;
+        t.schedule = Policy::schedule;
+        // a global lock transaction never reaches the commit that ends it
+        t.enterSite(Policy::globalLock ? NULL : site);
+        if (site != NULL && !Policy::globalLock && Policy::readOnlyTx)
+            t.read_only = !site->wrote();
+    }
+
+    static void begin(TxThread& t)
+    {
+        if constexpr (Policy::globalLock) {
+            global_lock.lock();
+            t.txCount++;
+        } else {
+            t.txBegin();
+        }
+    }
+
+    static void end(TxThread& t)
+    {
+        if constexpr (Policy::globalLock)
+            global_lock.unlock();
+        else
+            t.txEnd();
+    }
+};
+
+inline TxSite* txSiteOf(nullptr_t, TxSite* site = NULL)
+{
+    return site;
+}
+
+// The TxSite of a TxBegin("name") call, looked up once per call site. NULL
+// without a name
+#define TX_SITE(...) txSiteOf(nullptr __VA_OPT__(, []() { static TxSite* site = txSite(__VA_ARGS__); return site; }()))
+
+// Transaction on an explicit descriptor t, a TxThread of the calling thread.
+// Every TxBegin takes an optional call site name, e.g. TxBegin("transfer"),
+// to profile and adapt its transactions (see TxSite)
+#define TxBeginOn(t, Policy, readOnly, ...) StmPolicyOps<Policy>::prepare(t, readOnly, TX_SITE(__VA_ARGS__)); setjmp((t).jump_buffer); StmPolicyOps<Policy>::begin(t);
+#define TxEndOn(t, Policy) (StmPolicyOps<Policy>::end(t))
+
+#define TxBeginP(Policy, ...) TxBeginOn(_my_thread, Policy, false __VA_OPT__(,) __VA_ARGS__)
+#define TxBeginReadOnlyP(Policy, ...) TxBeginOn(_my_thread, Policy, true __VA_OPT__(,) __VA_ARGS__)
+#define TxEndP(Policy) TxEndOn(_my_thread, Policy)
+
+#define TxBegin(...) TxBeginP(DefaultStmPolicy __VA_OPT__(,) __VA_ARGS__)
+#define TxBeginReadOnly(...) TxBeginReadOnlyP(DefaultStmPolicy __VA_OPT__(,) __VA_ARGS__)
+#define TxEnd() TxEndP(DefaultStmPolicy)
 
 #endif
\ No newline at end of file
@@ -3,7 +3,7 @@ using namespace std;
 
 int main()
 {
-    RBTree rb;
+    RBTree<> rb;
     rb.insert(100);
     rb.insert(101);
     rb.insert(100);
@@ -0,0 +1,272 @@
+#include "include/stm.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <boost/program_options.hpp>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+namespace po = boost::program_options;
+
+// Fixed costs of the STM primitives, each timed in isolation. Every thread
+// works on its own words unless --shared is given, then all threads use the
+// same words and the numbers include the conflicts (see attempts/op).
+using namespace std;
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+#define WORDS_PER_THREAD 4096
+
+static uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct Result {
+    double ns;
+    double cycles;
+    double attempts; // transaction attempts per op, 1 means no aborts
+};
+
+// One shot barrier so every thread starts timing together
+class StartBarrier {
+    atomic<int> waiting;
+
+public:
+    StartBarrier(int count) : waiting(count) {}
+
+    void arriveAndWait()
+    {
+        waiting.fetch_sub(1);
+        while (waiting.load() > 0)
+            this_thread::yield();
+    }
+};
+
+struct Config {
+    int numThreads;
+    int64_t iters;
+    bool shared;
+    vector<intptr_t> words; // WORDS_PER_THREAD per thread, or one block if shared
+
+    intptr_t* wordsOf(int thread_id)
+    {
+        return &words[shared ? 0 : thread_id * WORDS_PER_THREAD];
+    }
+};
+
+/**
+ * @brief Runs body(words, i) for i in [0, iters) on every thread
+ *
+ * @param opsPerIter Primitives each call of body performs, results are per primitive
+ * @return Averages over the threads
+ */
+template <typename F>
+Result measure(Config& c, int opsPerIter, F body)
+{
+    vector<double> ns(c.numThreads), cyc(c.numThreads), attempts(c.numThreads);
+    StartBarrier ready(c.numThreads);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < c.numThreads; thread_id++) {
+        workers.push_back(thread([&, thread_id]() {
+            intptr_t* words = c.wordsOf(thread_id);
+            // warm up the thread's TxThread and the caches
+            for (int64_t i = 0; i < c.iters / 10; i++)
+                body(words, i);
+            ready.arriveAndWait();
+            int txBefore = _my_thread.txCount;
+            auto t1 = high_resolution_clock::now();
+            uint64_t c1 = cycles();
+            for (int64_t i = 0; i < c.iters; i++)
+                body(words, i);
+            uint64_t c2 = cycles();
+            auto t2 = high_resolution_clock::now();
+            double ops = (double) c.iters * opsPerIter;
+            ns[thread_id] = duration<double, nano>(t2 - t1).count() / ops;
+            cyc[thread_id] = (c2 - c1) / ops;
+            attempts[thread_id] = (_my_thread.txCount - txBefore) / ops;
+        }));
+    }
+    for (thread& t : workers)
+        t.join();
+    Result r { 0, 0, 0 };
+    for (int thread_id = 0; thread_id < c.numThreads; thread_id++) {
+        r.ns += ns[thread_id] / c.numThreads;
+        r.cycles += cyc[thread_id] / c.numThreads;
+        r.attempts += attempts[thread_id] / c.numThreads;
+    }
+    return r;
+}
+
+void print(const string& name, const Result& r)
+{
+    cout << left << setw(28) << name << right << fixed << setprecision(1)
+         << setw(12) << r.ns << setw(12) << r.cycles << setprecision(3) << setw(14) << r.attempts << endl;
+}
+
+// Stride between words touched in one transaction, so that each one lands on
+// its own lock stripe and its own cache line
+#define STRIDE 8
+
+int main(int argc, char** argv)
+{
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("num-threads,n", po::value<int>()->default_value(1), "Number of threads")
+        ("iters,i", po::value<int64_t>()->default_value(200000), "Iterations per thread of every benchmark")
+        ("shared", "All threads use the same words")
+        ("filter,f", po::value<string>()->default_value(""), "Only run benchmarks whose name contains this")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        cout << desc << "\n";
+        return 1;
+    }
+
+    Config c;
+    c.numThreads = vm["num-threads"].as<int>();
+    c.iters = vm["iters"].as<int64_t>();
+    c.shared = vm.count("shared") > 0;
+    c.words.assign((c.shared ? 1 : c.numThreads) * WORDS_PER_THREAD, 0);
+    string filter = vm["filter"].as<string>();
+    auto run = [&](const string& name, int opsPerIter, auto body) {
+        if (name.find(filter) != string::npos)
+            print(name, measure(c, opsPerIter, body));
+    };
+
+    cout << "Threads: " << c.numThreads << (c.shared ? ", shared words" : ", private words") << endl;
+    cout << left << setw(28) << "primitive" << right << setw(12) << "ns/op" << setw(12) << "cycles/op" << setw(14) << "attempts/op" << endl;
+
+    run("begin+end (read only)", 1, [](intptr_t*, int64_t) {
+        TxBeginReadOnly();
+        TxEnd();
+    });
+    run("begin+end", 1, [](intptr_t*, int64_t) {
+        TxBegin();
+        TxEnd();
+    });
+
+    const int loads = 64;
+    run("load", loads, [](intptr_t* words, int64_t) {
+        TxBegin();
+        for (int j = 0; j < loads; j++)
+            LOAD(words[j * STRIDE]);
+        TxEnd();
+    });
+    run("load (read only)", loads, [](intptr_t* words, int64_t) {
+        TxBeginReadOnly();
+        for (int j = 0; j < loads; j++)
+            LOAD(words[j * STRIDE]);
+        TxEnd();
+    });
+    // every load after the first store hits the write set
+    run("load after store", loads, [](intptr_t* words, int64_t) {
+        TxBegin();
+        STORE(words[0], 1);
+        for (int j = 0; j < loads; j++)
+            LOAD(words[0]);
+        TxEnd();
+    });
+    // stores to one word, so no extra locks are taken at commit
+    run("store", loads, [](intptr_t* words, int64_t i) {
+        TxBegin();
+        for (int j = 0; j < loads; j++)
+            STORE(words[0], i + j);
+        TxEnd();
+    });
+
+    // a 64 word record, copied word by word and as one range, per word
+    run("record load, per word", loads, [](intptr_t* words, int64_t) {
+        intptr_t record[loads];
+        TxBegin();
+        for (int j = 0; j < loads; j++)
+            record[j] = LOAD(words[j]);
+        TxEnd();
+        asm volatile("" : : "r"(record) : "memory");
+    });
+    run("record load, range", loads, [](intptr_t* words, int64_t) {
+        intptr_t record[loads];
+        TxBegin();
+        LOAD_RANGE(record, words, sizeof(record));
+        TxEnd();
+        asm volatile("" : : "r"(record) : "memory");
+    });
+    run("record store, per word", loads, [](intptr_t* words, int64_t i) {
+        TxBegin();
+        for (int j = 0; j < loads; j++)
+            STORE(words[j], i);
+        TxEnd();
+    });
+    run("record store, range", loads, [](intptr_t* words, int64_t i) {
+        intptr_t record[loads];
+        fill(record, record + loads, i);
+        TxBegin();
+        STORE_RANGE(words, record, sizeof(record));
+        TxEnd();
+    });
+
+    for (int k : { 1, 4, 16, 64, 256 }) {
+        run("commit with " + to_string(k) + " locks", 1, [k](intptr_t* words, int64_t i) {
+            TxBegin();
+            for (int j = 0; j < k; j++)
+                STORE(words[j * STRIDE], i);
+            TxEnd();
+        });
+    }
+
+    // Commit skips validation when no transaction committed since txBegin,
+    // so the clock is bumped to force it. The difference between the two
+    // is the cost of validating n reads
+    for (int n : { 1, 16, 256 }) {
+        run("commit, " + to_string(n) + " reads unvalidated", 1, [n](intptr_t* words, int64_t i) {
+            TxBegin();
+            for (int j = 0; j < n; j++)
+                LOAD(words[(j + 1) * STRIDE % WORDS_PER_THREAD]);
+            STORE(words[0], i);
+            TxEnd();
+        });
+        run("commit, " + to_string(n) + " reads validated", 1, [n](intptr_t* words, int64_t i) {
+            TxBegin();
+            for (int j = 0; j < n; j++)
+                LOAD(words[(j + 1) * STRIDE % WORDS_PER_THREAD]);
+            STORE(words[0], i);
+            global_version_clock.fetch_add(1);
+            TxEnd();
+        });
+    }
+
+    // one forced abort, then the retry commits. Compare with begin+end
+    run("abort+longjmp+retry", 1, [](intptr_t*, int64_t) {
+        volatile bool aborted = false;
+        TxBegin();
+        if (!aborted) {
+            aborted = true;
+            _my_thread.txAbort();
+        }
+        TxEnd();
+    });
+
+    // two transactions, one allocating and one freeing, through a word no
+    // other thread sees so a block is never freed twice
+    run("malloc+free (2 tx)", 1, [](intptr_t*, int64_t) {
+        static thread_local intptr_t block;
+        TxBegin();
+        STORE(block, MALLOC(64));
+        TxEnd();
+        TxBegin();
+        FREE((void*) LOAD(block));
+        TxEnd();
+    });
+}
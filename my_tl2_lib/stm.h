@@ -3,39 +3,49 @@
 
 #include "../include/stm.hpp"
 
-// #define STM_THREAD_T                    Thread
-// #define STM_SELF                        Self
-// #define STM_RO_FLAG                     ROFlag
+// STAMP binding. Every thread declares its descriptor as STM_SELF
+// (TM_ARGDECL) and gets it from STM_NEW_THREAD(), after which transactions,
+// loads and stores go through it and skip the thread local lookup. The
+// descriptor is the thread's own _my_thread, so a thread must only use the
+// one it got itself.
 
-#define STM_MALLOC(size)                MALLOC(size)
-#define STM_FREE(ptr)                   FREE(ptr)
+#define STM_THREAD_T                    TxThread
+#define STM_SELF                        Self
+#define STM_RO_FLAG                     ROFlag
 
-#define STM_VALID()                     (1)
-#define STM_RESTART()                   
+#define STM_MALLOC(size)                (STM_SELF->txMalloc(size))
+#define STM_FREE(ptr)                   (STM_SELF->txFree(ptr))
 
-#define STM_STARTUP()                   
-#define STM_SHUTDOWN()                  
+// Every load is validated when it is made, so a running transaction has
+// always seen a consistent snapshot
+#define STM_VALID()                     (1)
+#define STM_RESTART()                   (STM_SELF->txAbort())
 
-#define STM_NEW_THREAD()                
-#define STM_INIT_THREAD(t, id)          
-#define STM_FREE_THREAD(t)              
+#define STM_STARTUP()                   txStartup()
+#define STM_SHUTDOWN()                  txShutdown()
 
-#define STM_BEGIN_RD()                  TxBeginReadOnly()
-#define STM_BEGIN_WR()                  TxBegin()
-#define STM_END()                       TxEnd()
+#define STM_NEW_THREAD()                (&_my_thread)
+// The descriptor took a thread id of its own when it was constructed, the
+// STAMP id is not needed
+#define STM_INIT_THREAD(t, id)          ((void) (t), (void) (id))
+#define STM_FREE_THREAD(t)              ((t)->txRetire())
 
+#define STM_BEGIN(isReadOnly)           TxBeginOn(*STM_SELF, DefaultStmPolicy, isReadOnly)
+#define STM_BEGIN_RD()                  STM_BEGIN(true)
+#define STM_BEGIN_WR()                  STM_BEGIN(false)
+#define STM_END()                       TxEndOn(*STM_SELF, DefaultStmPolicy)
 
-#define STM_READ(var)                   LOAD(var)
-#define STM_READ_F(var)                 LOAD(var)
-#define STM_READ_P(var)                 LOAD(var)
+#define STM_READ(var)                   (STM_SELF->txLoad((intptr_t*) &(var)))
+#define STM_READ_F(var)                 (txLoadValue(*STM_SELF, var))
+#define STM_READ_P(var)                 ((void*) STM_SELF->txLoad((intptr_t*) &(var)))
 
-#define STM_WRITE(var, val)             STORE(var, val)
-#define STM_WRITE_F(var, val)           STORE(var, val)
-#define STM_WRITE_P(var, val)           STORE(var, val)
+#define STM_WRITE(var, val)             (STM_SELF->txStore((intptr_t*) &(var), (intptr_t) (val)))
+#define STM_WRITE_F(var, val)           (txStoreValue(*STM_SELF, var, (remove_reference_t<decltype(var)>) (val)))
+#define STM_WRITE_P(var, val)           (STM_SELF->txStore((intptr_t*) &(var), (intptr_t) (val)))
 
 #define STM_LOCAL_WRITE(var, val)       ({var = val; var;})
 #define STM_LOCAL_WRITE_F(var, val)     ({var = val; var;})
 #define STM_LOCAL_WRITE_P(var, val)     ({var = val; var;})
 
 
-#endif
\ No newline at end of file
+#endif
@@ -8,6 +8,8 @@
 #include <algorithm>
 #include <signal.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <iomanip>
 
 bool TxThread::inReadSet(uint64_t addr){
     return find(read_set.begin(), read_set.end(), (intptr_t*) addr) != read_set.end();
@@ -33,17 +35,151 @@ void registerSignalHandlers(){
     sigaction(SIGSEGV, &sig_handler, NULL);
 }
 
+static const char* lock_table_pages = "unmapped";
+
+// A thread's epoch is odd while it runs a transaction. Serial transactions
+// wait for the odd ones to change, and so does conflict scheduling. Only the
+// first TX_EPOCH_THREADS ids have one, later threads are not waited for
+#define TX_EPOCH_THREADS 4096
+struct alignas(64) TxEpoch {
+    atomic<int64_t> value;
+};
+static TxEpoch tx_epochs[TX_EPOCH_THREADS];
+// Set while a serial transaction or exclusive mode runs, taken by serial_lock
+static atomic<bool> serial_running { false };
+static mutex serial_lock;
+
+// Conflict scheduling (SchedulerPolicy): every stripe holds the id + 1 of
+// the thread that last locked it, 0 if none did
+static atomic<uint16_t>* last_lockers = nullptr;
+
+static atomic<uint16_t>& lastLockerOf(VersionedLock* lock){
+    return last_lockers[lock - PSLocks];
+}
+
+// The lock table is mapped, not a static array, so no constructors run
+// before main and the kernel only backs stripes with (zeroed) pages as they
+// are touched. Stripes are hashed all over the table, so huge pages cut the
+// TLB misses of GET_LOCK: explicit ones if some are reserved, else
+// transparent ones on a 2MB aligned range
+static VersionedLock* mapLockTableOnce(){
+    size_t bytes = NUM_LOCKS * sizeof(VersionedLock);
+    void* table = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    table = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(table != MAP_FAILED){
+        lock_table_pages = "hugetlb";
+    }
+#endif
+    if(table == MAP_FAILED){
+        size_t hugePage = 2 << 20;
+        void* mapped = mmap(NULL, bytes + hugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mapped == MAP_FAILED){
+            perror("mmap of the lock table");
+            abort();
+        }
+        table = (void*) (((uintptr_t) mapped + hugePage - 1) & ~(uintptr_t) (hugePage - 1));
+        lock_table_pages = "4k";
+#ifdef MADV_HUGEPAGE
+        if(madvise(table, bytes, MADV_HUGEPAGE) == 0){
+            lock_table_pages = "thp";
+        }
+#endif
+    }
+    return (VersionedLock*) table;
+}
+
+void mapLockTable(){
+    static once_flag mapped;
+    call_once(mapped, []() {
+        PSLocks = mapLockTableOnce();
+        // zeroed and only touched by scheduled commits, like the lock table
+        void* lockers = mmap(NULL, NUM_LOCKS * sizeof(atomic<uint16_t>), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(lockers == MAP_FAILED){
+            perror("mmap of the last lockers");
+            abort();
+        }
+        last_lockers = (atomic<uint16_t>*) lockers;
+    });
+}
+
+const char* lockTablePages(){
+    return lock_table_pages;
+}
+
+// Lowest id not held by a live thread
+static int acquireThreadId(){
+    lock_guard<mutex> guard(thread_id_lock);
+    if(free_thread_ids.empty()){
+        return next_thread_id.fetch_add(1);
+    }
+    auto lowest = min_element(free_thread_ids.begin(), free_thread_ids.end());
+    int id = *lowest;
+    free_thread_ids.erase(lowest);
+    return id;
+}
+
 TxThread::TxThread()
     : rv { 0 }
     , wv { 0 }
     , locks_held {}
+    , id(acquireThreadId())
     , inTx(false)
     , txCount(0)
+    , numAborts(0)
     , numLoads(0)
     , numStores(0)
+    , read_only(false)
+    , backoff(false)
+    , delay(1)
+    , schedule(false)
+    , conflict_lock(NULL)
+    , enemy(-1)
+    , strikes(0)
+    , site(NULL)
+    , siteStart(0)
+    , admitted(false)
+    , serial(false)
+    , quiesce(true)
+    , exclusive(false)
+
+{
+    mapLockTable();
+    registerSignalHandlers();
+}
 
+TxThread::~TxThread()
+{
+    lock_guard<mutex> guard(thread_id_lock);
+    free_thread_ids.push_back(id);
+}
+
+// Counts of the threads retired so far, see txShutdown
+static atomic<int64_t> retired_tx_count { 0 };
+static atomic<int64_t> retired_aborts { 0 };
+
+void TxThread::txRetire()
+{
+    if (inTx)
+        cout << "WARNING: txRetire() called in Tx" << endl;
+    retired_tx_count += txCount;
+    retired_aborts += numAborts;
+    txCount = 0;
+    numAborts = 0;
+}
+
+void txStartup()
 {
     registerSignalHandlers();
+    retired_tx_count = 0;
+    retired_aborts = 0;
+}
+
+void txShutdown()
+{
+    cout << "TL2 system shutdown:" << endl;
+    cout << "  GCLOCK=" << global_version_clock.load() << " Starts=" << retired_tx_count.load()
+         << " Aborts=" << retired_aborts.load() << endl;
 }
 
 // Start new transaction
@@ -53,9 +189,11 @@ void TxThread::txBegin()
     // Profiling/misc. info
     if (inTx)
         cout << "WARNING: txBegin() called but already in Tx" << endl;
-    inTx = true;
     txCount++;
-    delay = 0;
+    if (exclusive) {
+        return;
+    }
+    inTx = true;
     // Reset from previous Tx
     write_map.clear();
     read_set.clear();
@@ -65,13 +203,188 @@ void TxThread::txBegin()
     assert(locks_held.size() == 0);
     assert(required_write_locks.size() == 0);
 
+    if (schedule) {
+        scheduleBegin();
+    }
+    if (site != NULL && !serial && txCount - siteStart > site->serialAfter()) {
+        enterSerial();
+    }
+    beginEpoch();
+
     // Step 1. Sample global version-clock
     rv = global_version_clock.load();
     // global_lock.lock();
 }
 
+// Before a scheduled attempt: once enemy caused enough recent aborts, wait
+// for its running transaction to end. Waiting happens outside of any
+// transaction (this thread's epoch is even), so two threads never wait on
+// each other
+void TxThread::scheduleBegin()
+{
+    if (strikes >= SCHED_STRIKES && enemy >= 0 && enemy < TX_EPOCH_THREADS) {
+        atomic<int64_t>& theirs = tx_epochs[enemy].value;
+        int64_t epoch = theirs.load();
+        if (epoch & 1) {
+            while (theirs.load() == epoch)
+                this_thread::yield();
+        }
+    }
+}
+
+void TxThread::scheduleEnd(bool committed)
+{
+    if (committed && strikes > 0) {
+        strikes--;
+    }
+}
+
+// Makes this thread's epoch odd. The epoch is published before the check of
+// serial_running, and quiesceOthers sets serial_running before it reads the
+// epochs (both sequentially consistent), so either the serial transaction
+// waits for this one or this one sees it and waits for it to end
+void TxThread::beginEpoch()
+{
+    if (id >= TX_EPOCH_THREADS || !quiesce) {
+        return;
+    }
+    atomic<int64_t>& mine = tx_epochs[id].value;
+    while (true) {
+        mine.store(mine.load(memory_order_relaxed) + 1);
+        if (serial || !serial_running.load()) {
+            return;
+        }
+        mine.store(mine.load(memory_order_relaxed) + 1, memory_order_release);
+        while (serial_running.load(memory_order_acquire)) {
+            this_thread::yield();
+        }
+    }
+}
+
+void TxThread::endEpoch()
+{
+    if (id < TX_EPOCH_THREADS && quiesce) {
+        atomic<int64_t>& mine = tx_epochs[id].value;
+        mine.store(mine.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+}
+
+// Waits until no thread but self is in a transaction, and keeps them from
+// starting one (see beginEpoch) until resumeOthers. Only one thread at a
+// time holds the others, the rest queue up on serial_lock
+static void quiesceOthers(int self)
+{
+    serial_lock.lock();
+    serial_running.store(true);
+    int threads = min(next_thread_id.load(), TX_EPOCH_THREADS);
+    for (int i = 0; i < threads; i++) {
+        if (i == self) {
+            continue;
+        }
+        int64_t epoch = tx_epochs[i].value.load();
+        if (epoch & 1) {
+            while (tx_epochs[i].value.load() == epoch)
+                this_thread::yield();
+        }
+    }
+}
+
+static void resumeOthers()
+{
+    serial_running.store(false, memory_order_release);
+    serial_lock.unlock();
+}
+
+// Called between attempts, with this thread's epoch even. Every other
+// thread finishes the transaction it is in and then waits in beginEpoch
+// until leaveSerial
+void TxThread::enterSerial()
+{
+    quiesceOthers(id);
+    serial = true;
+}
+
+void TxThread::leaveSerial()
+{
+    serial = false;
+    resumeOthers();
+}
+
+void TxThread::enterExclusive()
+{
+    if (inTx || exclusive) {
+        cout << "WARNING: exclusive mode entered in Tx or twice" << endl;
+        return;
+    }
+    quiesceOthers(id);
+    exclusive = true;
+}
+
+void TxThread::leaveExclusive()
+{
+    if (!exclusive) {
+        cout << "WARNING: exclusive mode left but not entered" << endl;
+        return;
+    }
+    exclusive = false;
+    resumeOthers();
+}
+
+void txEnterExclusive()
+{
+    _my_thread.enterExclusive();
+}
+
+void txLeaveExclusive()
+{
+    _my_thread.leaveExclusive();
+}
+
+// Blames the abort on the thread that last locked the stripe it failed on
+void TxThread::blameConflict()
+{
+    if (conflict_lock == NULL) {
+        return;
+    }
+    int locker = lastLockerOf(conflict_lock).load(memory_order_relaxed) - 1;
+    conflict_lock = NULL;
+    if (locker < 0 || locker == id) {
+        return;
+    }
+    strikes = locker == enemy ? strikes + 1 : 1;
+    enemy = locker;
+}
+
+// clear() is O(bucket count), so a transaction with an unusually large write
+// set would slow every later one down. Drop its buckets instead
+void TxThread::clearWriteMap()
+{
+    if (write_map.size() > WRITE_MAP_KEEP) {
+        write_map = decltype(write_map)();
+    } else {
+        write_map.clear();
+    }
+}
+
+// Lets go of the write locks taken so far, without changing their versions
+void TxThread::releaseLocks()
+{
+    for(VersionedLock* write_lock: locks_held){
+        assert(write_lock->isLocked());
+        write_lock->abortUnlock();
+    }
+    locks_held.clear();
+}
+
 // Called by txEnd at the end of a transaction
 void TxThread::txCommit()
+{
+    if (txTryCommit() != TX_OK) {
+        txAbort();
+    }
+}
+
+TxStatus TxThread::txTryCommit()
 {
     assert(inTx);
     // 3. Lock write-set
@@ -84,12 +397,17 @@ void TxThread::txCommit()
 
         assert(locks_held.find(lock) == locks_held.end());
 
-        // Acquire lock, just 1 try
+        // Acquire lock, just 1 try. Waiting while holding the others
+        // would block their readers too, so let them go
         if (lock->tryLock()) {
             locks_held.insert(lock);
+            if (schedule) {
+                lastLockerOf(lock).store(id + 1, memory_order_relaxed);
+            }
         } else {
-            txAbort();
-            assert(0);
+            conflict_lock = lock;
+            releaseLocks();
+            return TX_BUSY;
         }
     }
 
@@ -106,9 +424,10 @@ void TxThread::txCommit()
             VersionedLock* read_lock = &GET_LOCK(read_addr);
             // "For each location in the read-set... the versioned-write-lock is <= rv"
             // "We also verify memory locations have not been locked by other threads"
-            if(read_lock->version > rv || (read_lock->locked && locks_held.find(read_lock) == locks_held.end())){
-                txAbort();
-                assert(0);
+            int64_t sample = read_lock->sample();
+            if(VersionedLock::versionOf(sample) > rv || (VersionedLock::lockedIn(sample) && locks_held.find(read_lock) == locks_held.end())){
+                conflict_lock = read_lock;
+                return TX_CONFLICT;
             }
         }
     }
@@ -131,22 +450,24 @@ void TxThread::txCommit()
                 // assert(0);
             }
             assert(locks_held.count(lock) == 1);
-            assert(lock->locked);
+            assert(lock->isLocked());
         }
     }
     #endif
 
     for(VersionedLock* write_lock: locks_held){
-        assert(wv > write_lock->version);
-        assert(write_lock->locked);
+        assert(wv > write_lock->version());
+        assert(write_lock->isLocked());
         write_lock->unlock(wv);
-        assert(!write_lock->locked);
     }
 
     // Actually perform frees now
     for(void* addr: speculative_free){
         free(addr);
     }
+    if (site != NULL) {
+        siteCommitted();
+    }
 
     // Tx complete successfully, clean up
     speculative_malloc.clear();
@@ -154,12 +475,31 @@ void TxThread::txCommit()
     required_write_locks.clear();
 
     locks_held.clear();
-    write_map.clear();
+    clearWriteMap();
+    if (schedule) {
+        scheduleEnd(true);
+    }
+    endEpoch();
+    if (serial) {
+        leaveSerial();
+    }
+    return TX_OK;
 }
 
-void TxThread::txAbort()
+// Undoes the transaction, leaving the thread outside of it
+void TxThread::txRollback()
 {
     inTx = false;
+    numAborts++;
+    if (schedule) {
+        blameConflict();
+        scheduleEnd(false);
+    }
+    if (site != NULL) {
+        TxSite::add(site->stripes[id % TX_SITE_STRIPES].aborts, 1);
+    }
+    // A serial transaction keeps running alone through its retries
+    endEpoch();
 
     for(void* addr: speculative_malloc){
         free(addr);
@@ -167,26 +507,25 @@ void TxThread::txAbort()
     speculative_malloc.clear();
     speculative_free.clear();
 
-    for(VersionedLock* write_lock: locks_held){
-        assert(write_lock->locked);
-        write_lock->abortUnlock();
-        assert(!write_lock->locked);
-    }
-
+    releaseLocks();
     required_write_locks.clear();
     // global_lock.unlock();
-    locks_held.clear();
-    write_map.clear();
+    clearWriteMap();
     #ifndef NDEBUG
     wv = -1; // make it clear we can't use these until they are set later
     rv = -1;
     #endif
+}
 
-    #ifdef USE_BACKOFF
-    usleep(delay);
-    if(delay < 10000) // Maximum backoff
-        delay *= 2;
-    #endif
+void TxThread::txAbort()
+{
+    txRollback();
+
+    if(backoff || (site != NULL && site->backoff())){
+        usleep(delay);
+        if(delay < 10000) // Maximum backoff
+            delay *= 2;
+    }
 
     longjmp(jump_buffer, txCount);
     assert(0);
@@ -195,6 +534,8 @@ void TxThread::txAbort()
 // Cleanup after Tx
 void TxThread::txEnd()
 {
+    if (exclusive)
+        return;
     if (!inTx)
         cout << "WARNING: txEnd() called but not in Tx" << endl;
     // cout << "starting txCommit: " << txCount << endl;
@@ -211,38 +552,195 @@ intptr_t TxThread::txLoad(intptr_t* addr)
     if (!inTx) {
         return *addr;
     }
+    intptr_t value;
+    if (txTryLoad(addr, value) != TX_OK) {
+        txAbort();
+    }
+    return value;
+}
 
+// A stripe that is only locked is TX_BUSY, one with a version past rv is
+// TX_CONFLICT whether locked or not
+static inline TxStatus checkSample(int64_t sample, int64_t rv)
+{
+    if (VersionedLock::versionOf(sample) > rv) {
+        return TX_CONFLICT;
+    }
+    return VersionedLock::lockedIn(sample) ? TX_BUSY : TX_OK;
+}
+
+TxStatus TxThread::txTryLoad(intptr_t* addr, intptr_t& value)
+{
+    assert(inTx);
     if(read_only){
-        intptr_t return_value = *addr;
+        value = *addr;
         VersionedLock* lock = &GET_LOCK(addr);
-        // 2. Post-validation
-        if (lock->locked || lock->version > rv) {
-            txAbort();
+        // 2. Post-validation, the fence keeps the value load before it
+        atomic_thread_fence(memory_order_acquire);
+        TxStatus status = checkSample(lock->sample(), rv);
+        if (status != TX_OK) {
+            conflict_lock = lock;
         }
-        return return_value;
+        return status;
     }
 
     // 2. Pre-validation
     VersionedLock* lock = &GET_LOCK(addr);
-    int64_t prior_version = lock->version;
-    if (prior_version > rv || lock->locked) {
-        txAbort();
-        assert(0);
+    int64_t prior = lock->sample();
+    TxStatus status = checkSample(prior, rv);
+    if (status != TX_OK) {
+        conflict_lock = lock;
+        return status;
     }
 
     auto iter = write_map.find(addr);
     if (iter != write_map.end()) {
-        return iter->second;
+        value = iter->second;
+        return TX_OK;
+    }
+    value = *addr;
+
+    // 2. Post-validation, unchanged since the pre-validation. The fence keeps
+    // the value load before it
+    atomic_thread_fence(memory_order_acquire);
+    int64_t sample = lock->sample();
+    if (sample != prior) {
+        conflict_lock = lock;
+        return VersionedLock::versionOf(sample) == VersionedLock::versionOf(prior) ? TX_BUSY : TX_CONFLICT;
     }
     read_set.push_back(addr);
-    intptr_t return_value = *addr;
+    return TX_OK;
+}
 
-    int64_t new_version = lock->version;
-    // 2. Post-validation
-    if (new_version != prior_version || new_version > rv || lock->locked) {
+// Aligned words [first, last) that the bytes [begin, begin + bytes) overlap
+#define WORD_RANGE(begin, bytes, first, last) \
+    intptr_t* first = (intptr_t*) ((uintptr_t) (begin) & ~(sizeof(intptr_t) - 1)); \
+    intptr_t* last = (intptr_t*) (((uintptr_t) (begin) + (bytes) + sizeof(intptr_t) - 1) & ~(sizeof(intptr_t) - 1))
+
+// Same checks as txLoad, in bulk: every stripe is sampled once before a
+// single memcpy and once after it, with one fence between the copy and the
+// second pass instead of one per word. Words in the write set are then
+// patched in from it
+void TxThread::txLoadRange(void* dst, const void* src, size_t bytes)
+{
+    if (!inTx || bytes == 0) {
+        memcpy(dst, src, bytes);
+        return;
+    }
+    WORD_RANGE(src, bytes, first, last);
+    size_t words = last - first;
+
+    if(read_only){
+        memcpy(dst, src, bytes);
+        atomic_thread_fence(memory_order_acquire);
+        for (size_t i = 0; i < words; i++) {
+            int64_t sample = GET_LOCK(first + i).sample();
+            if (VersionedLock::lockedIn(sample) || VersionedLock::versionOf(sample) > rv) {
+                conflict_lock = &GET_LOCK(first + i);
+                txAbort();
+            }
+        }
+        return;
+    }
+
+    boost::container::small_vector<int64_t, 64> prior(words);
+    for (size_t i = 0; i < words; i++) {
+        prior[i] = GET_LOCK(first + i).sample();
+        if (VersionedLock::versionOf(prior[i]) > rv || VersionedLock::lockedIn(prior[i])) {
+            conflict_lock = &GET_LOCK(first + i);
+            txAbort();
+        }
+    }
+    memcpy(dst, src, bytes);
+    atomic_thread_fence(memory_order_acquire);
+    for (size_t i = 0; i < words; i++) {
+        if (GET_LOCK(first + i).sample() != prior[i]) {
+            conflict_lock = &GET_LOCK(first + i);
+            txAbort();
+        }
+    }
+
+    uintptr_t begin = (uintptr_t) src;
+    uintptr_t end = begin + bytes;
+    for (intptr_t* w = first; w < last; w++) {
+        auto iter = write_map.empty() ? write_map.end() : write_map.find(w);
+        if (iter == write_map.end()) {
+            read_set.push_back(w);
+            continue;
+        }
+        uintptr_t lo = max((uintptr_t) w, begin);
+        uintptr_t hi = min((uintptr_t) (w + 1), end);
+        memcpy((char*) dst + (lo - begin), (char*) &iter->second + (lo - (uintptr_t) w), hi - lo);
+    }
+}
+
+// Same as a txStore per word, with the write set grown once for the whole
+// range. A word the range only partly covers keeps its other bytes
+void TxThread::txStoreRange(void* dst, const void* src, size_t bytes)
+{
+    if (!inTx || bytes == 0) {
+        memcpy(dst, src, bytes);
+        return;
+    }
+
+    // A read only transaction keeps no read set, restart it as read-write
+    if(read_only){
+        read_only = false;
         txAbort();
     }
-    return return_value;
+
+    WORD_RANGE(dst, bytes, first, last);
+    uintptr_t begin = (uintptr_t) dst;
+    uintptr_t end = begin + bytes;
+    write_map.reserve(write_map.size() + (last - first));
+    required_write_locks.reserve(required_write_locks.size() + (last - first));
+    for (intptr_t* w = first; w < last; w++) {
+        uintptr_t lo = max((uintptr_t) w, begin);
+        uintptr_t hi = min((uintptr_t) (w + 1), end);
+        intptr_t word = (lo == (uintptr_t) w && hi == (uintptr_t) (w + 1)) ? 0 : txLoad(w);
+        memcpy((char*) &word + (lo - (uintptr_t) w), (const char*) src + (lo - begin), hi - lo);
+        write_map[w] = word;
+        required_write_locks.push_back(&GET_LOCK(w));
+    }
+}
+
+// Goes through a private copy, so the ranges may overlap as in memmove
+void TxThread::txMemcpy(void* dst, const void* src, size_t bytes)
+{
+    boost::container::small_vector<char, 512> copy(bytes, boost::container::default_init);
+    txLoadRange(copy.data(), src, bytes);
+    txStoreRange(dst, copy.data(), bytes);
+}
+
+void TxThread::txMemset(void* dst, int c, size_t bytes)
+{
+    boost::container::small_vector<char, 512> fill(bytes, (char) c);
+    txStoreRange(dst, fill.data(), bytes);
+}
+
+// Early release: addr is no longer validated at commit, so later writes to it
+// by other transactions cannot abort this one. Only safe for reads the result
+// does not depend on, e.g. the path of a lookup once it moved past a node.
+// Read only transactions keep no read set, nothing to do there
+void TxThread::txRelease(intptr_t* addr)
+{
+    if (!inTx || read_only) {
+        return;
+    }
+    read_set.erase(remove(read_set.begin(), read_set.end(), addr), read_set.end());
+}
+
+TxStatus TxThread::txTryStore(intptr_t* addr, intptr_t val)
+{
+    assert(inTx);
+    // A read only transaction keeps no read set, it has to run as read-write
+    if(read_only){
+        read_only = false;
+        return TX_CONFLICT;
+    }
+    write_map[addr] = val;
+    required_write_locks.push_back(&GET_LOCK(addr));
+    return TX_OK;
 }
 
 void TxThread::txStore(intptr_t* addr, intptr_t val)
@@ -253,12 +751,11 @@ void TxThread::txStore(intptr_t* addr, intptr_t val)
         return;
     }
 
-    #ifdef OPTIMISTIC_READ_ONLY
+    // A read only transaction keeps no read set, restart it as read-write
     if(read_only){
         read_only = false;
         txAbort();
     }
-    #endif
 
     // cout << "setting addr: " << addr << " val: " << val << endl;
     // Speculative, just write to log
@@ -273,12 +770,10 @@ void* TxThread::txMalloc(size_t size)
         return malloc(size);
     }
 
-    #ifdef OPTIMISTIC_READ_ONLY
     if(read_only){
         read_only = false;
         txAbort();
     }
-    #endif
 
     void* ptr = malloc(size);
     // read_set.push_back((intptr_t*) ptr);
@@ -286,6 +781,24 @@ void* TxThread::txMalloc(size_t size)
     return ptr;
 }
 
+// Same as txMalloc, size must be a multiple of alignment (see aligned_alloc)
+void* TxThread::txMallocAligned(size_t alignment, size_t size)
+{
+    assert(size != 0 && size % alignment == 0);
+    if (!inTx) {
+        return aligned_alloc(alignment, size);
+    }
+
+    if(read_only){
+        read_only = false;
+        txAbort();
+    }
+
+    void* ptr = aligned_alloc(alignment, size);
+    speculative_malloc.push_back(ptr);
+    return ptr;
+}
+
 void TxThread::txFree(void* addr)
 {
     assert(addr != 0);
@@ -293,12 +806,10 @@ void TxThread::txFree(void* addr)
         return free(addr);
     }
 
-    #ifdef OPTIMISTIC_READ_ONLY
     if(read_only){
         read_only = false;
         txAbort();
     }
-    #endif
 
     // cout << "marking free: " << addr << endl;
     // NOTE: Can't really do anything to this address, just trusting users don't have use-after-free
@@ -310,7 +821,9 @@ void TxThread::txFree(void* addr)
     VersionedLock* lock = &GET_LOCK(addr);
 
     // 2. Post-validation
-    if (lock->locked || lock->version > rv) {
+    int64_t sample = lock->sample();
+    if (VersionedLock::lockedIn(sample) || VersionedLock::versionOf(sample) > rv) {
+        conflict_lock = lock;
         txAbort();
     }
 
@@ -322,3 +835,155 @@ void TxThread::txFree(void* addr)
         required_write_locks.push_back(lock);
     }
 }
+
+// Call site profiles, see TxSite
+
+static mutex sites_lock;
+
+// Function local, so sites can be looked up during static initialization
+static vector<TxSite*>& allSites(){
+    static vector<TxSite*> sites;
+    return sites;
+}
+
+TxSite* txSite(const char* name)
+{
+    lock_guard<mutex> guard(sites_lock);
+    for (TxSite* site : allSites()) {
+        if (site->name == name) {
+            return site;
+        }
+    }
+    allSites().push_back(new TxSite(name));
+    return allSites().back();
+}
+
+TxSite::Counts TxSite::counts() const
+{
+    Counts total;
+    for (const Stripe& stripe : stripes) {
+        total.commits += stripe.commits.load(memory_order_relaxed);
+        total.aborts += stripe.aborts.load(memory_order_relaxed);
+        total.readWords += stripe.readWords.load(memory_order_relaxed);
+        total.writeWords += stripe.writeWords.load(memory_order_relaxed);
+        total.serial += stripe.serial.load(memory_order_relaxed);
+        total.maxRetries = max(total.maxRetries, stripe.maxRetries.load(memory_order_relaxed));
+    }
+    return total;
+}
+
+void TxSite::fix(bool backoff, int limit, int serialAfter)
+{
+    fixed.store(true);
+    backoffOn.store(backoff);
+    concurrency.store(limit);
+    serialRetries.store(serialAfter);
+}
+
+// Run by the committing thread whose stripe reached a multiple of
+// TX_SITE_ADAPT_PERIOD, skipped while another thread adapts the site
+void TxSite::adapt()
+{
+    if (fixed.load(memory_order_relaxed) || adapting.exchange(true, memory_order_acquire)) {
+        return;
+    }
+    int64_t commits = 0;
+    int64_t aborts = 0;
+    int threads = 0;
+    for (Stripe& stripe : stripes) {
+        int64_t c = stripe.commits.load(memory_order_relaxed);
+        int64_t a = stripe.aborts.load(memory_order_relaxed);
+        if (c != stripe.adaptedCommits || a != stripe.adaptedAborts) {
+            threads++;
+        }
+        commits += c - stripe.adaptedCommits;
+        aborts += a - stripe.adaptedAborts;
+        stripe.adaptedCommits = c;
+        stripe.adaptedAborts = a;
+    }
+    double rate = commits + aborts == 0 ? 0 : (double) aborts / (commits + aborts);
+
+    backoffOn.store(rate > TX_SITE_BACKOFF_RATE, memory_order_relaxed);
+    int limit = concurrency.load(memory_order_relaxed);
+    if (rate > TX_SITE_THROTTLE_RATE) {
+        limit = max(1, (limit == 0 ? threads : limit) / 2);
+    } else if (rate < TX_SITE_BACKOFF_RATE && limit > 0) {
+        limit = limit * 2 >= threads ? 0 : limit * 2;
+    }
+    concurrency.store(limit, memory_order_relaxed);
+    serialRetries.store(rate > TX_SITE_THROTTLE_RATE ? TX_SITE_SERIAL_EARLY : TX_SITE_SERIAL_AFTER, memory_order_relaxed);
+    adapting.store(false, memory_order_release);
+}
+
+void TxThread::enterSite(TxSite* s)
+{
+    if (exclusive) {
+        s = NULL;
+    }
+    site = s;
+    siteStart = txCount;
+    if (s == NULL) {
+        return;
+    }
+    while (true) {
+        int limit = s->limit();
+        if (limit == 0) {
+            return;
+        }
+        int running = s->running.load(memory_order_relaxed);
+        if (running < limit) {
+            if (s->running.compare_exchange_weak(running, running + 1, memory_order_acquire)) {
+                admitted = true;
+                return;
+            }
+        } else {
+            this_thread::yield();
+        }
+    }
+}
+
+// Records the commit in this thread's stripe and lets the next transaction
+// of the site in
+void TxThread::siteCommitted()
+{
+    TxSite::Stripe& stripe = site->stripes[id % TX_SITE_STRIPES];
+    int64_t retries = txCount - siteStart - 1;
+    TxSite::add(stripe.commits, 1);
+    TxSite::add(stripe.readWords, read_set.size());
+    TxSite::add(stripe.writeWords, write_map.size());
+    if ((!write_map.empty() || !speculative_malloc.empty()) && !site->wrote()) {
+        site->wroteOnce.store(true, memory_order_relaxed);
+    }
+    if (serial) {
+        TxSite::add(stripe.serial, 1);
+    }
+    if (retries > stripe.maxRetries.load(memory_order_relaxed)) {
+        stripe.maxRetries.store(retries, memory_order_relaxed);
+    }
+    if (admitted) {
+        site->running.fetch_sub(1, memory_order_release);
+        admitted = false;
+    }
+    if (stripe.commits.load(memory_order_relaxed) % TX_SITE_ADAPT_PERIOD == 0) {
+        site->adapt();
+    }
+}
+
+void txDumpSites(ostream& out)
+{
+    lock_guard<mutex> guard(sites_lock);
+    out << left << setw(24) << "site" << right << setw(12) << "commits" << setw(12) << "aborts" << setw(8) << "abort%"
+        << setw(10) << "retries" << setw(8) << "max" << setw(9) << "read" << setw(9) << "write" << setw(10) << "serial"
+        << setw(9) << "backoff" << setw(7) << "limit" << setw(8) << "serial@" << setw(6) << "mode" << endl;
+    for (TxSite* site : allSites()) {
+        TxSite::Counts c = site->counts();
+        double attempts = max<int64_t>(c.commits + c.aborts, 1);
+        double commits = max<int64_t>(c.commits, 1);
+        out << left << setw(24) << site->name << right << setw(12) << c.commits << setw(12) << c.aborts
+            << fixed << setprecision(1) << setw(8) << 100 * c.aborts / attempts << setprecision(2)
+            << setw(10) << c.aborts / commits << setw(8) << c.maxRetries << setprecision(1)
+            << setw(9) << c.readWords / commits << setw(9) << c.writeWords / commits << setw(10) << c.serial
+            << setw(9) << (site->backoff() ? "on" : "off") << setw(7) << site->limit() << setw(8) << site->serialAfter()
+            << setw(6) << (site->wrote() ? "rw" : "ro") << defaultfloat << endl;
+    }
+}
@@ -1,29 +1,44 @@
 #include "include/HashMap.hpp"
 #include "include/RBTree.hpp"
+#include "include/SkipList.hpp"
+#include "include/BPlusTree.hpp"
+#include "include/Deque.hpp"
+#include "include/PriorityQueue.hpp"
+#include "include/StripedHashMap.hpp"
+#include "include/LockFreeHashMap.hpp"
+#include "include/RWLockTree.hpp"
+#include "include/LockFreeSkipList.hpp"
+#include "include/CoTx.hpp"
 #include <algorithm>
 #include <iostream>
 #include <random>
 #include <thread>
 #include <unordered_set>
+#include <atomic>
+#include <set>
+#include <deque>
 #include <unordered_map>
+#include <map>
+#include <sstream>
 #include <vector>
 #include <cmath>
 #include <cstdlib>
 #include "include/stm.hpp"
+#include "my_tl2_lib/stm.h"
 
 using namespace std;
 int failures = 0;
 
 
 namespace RBTreeTests {
-void checkOrderAndSize(unordered_set<int64_t>& s, RBTree& rb)
+void checkOrderAndSize(unordered_set<int64_t>& s, RBTree<>& rb)
 {
     // See if the size is right
     if (s.size() != rb.size()) {
         cout << "RBTree and set have different sizes: " << s.size() << " " << rb.size() << endl;
         failures++;
     }
-    vector<int> v(s.begin(), s.end());
+    vector<int64_t> v(s.begin(), s.end());
     sort(v.begin(), v.end());
     // See if order is maintained
     if (rb.inorder() != v) {
@@ -43,7 +58,7 @@ void largeRand()
     // Do a bunch of random insertions
     cout << "Starting large rand" << endl;
     unordered_set<int64_t> s;
-    RBTree rb;
+    RBTree<> rb;
     int N = 100000;
     for (int i = 0; i < N; i++) {
         TxBegin();
@@ -80,15 +95,41 @@ void largeRand()
     }
 }
 
-void largeRandThreads(int numInserts, int numDeletes, int numThreads)
+// Runs rebalance() on a relaxed tree in the background until stopped
+class Maintenance {
+    atomic<bool> done;
+    thread worker;
+
+public:
+    Maintenance(RBTree<>& rb, bool relaxed) : done(false) {
+        if (relaxed) {
+            worker = thread([&rb, this]() {
+                while (!done) {
+                    rb.rebalance();
+                }
+            });
+        }
+    }
+
+    // Stops the background thread and drains whatever repairs are left
+    void finish(RBTree<>& rb) {
+        done = true;
+        if (worker.joinable()) {
+            worker.join();
+            rb.rebalance();
+        }
+    }
+};
+
+void largeRandThreads(int numInserts, int numDeletes, int numThreads, bool relaxed = false)
 {
     // Do a bunch of random insertions
-    cout << "Starting large rand with " << numThreads << " threads" << endl;
+    cout << "Starting large rand with " << numThreads << " threads" << (relaxed ? " (relaxed)" : "") << endl;
     const int64_t keyMax = 20000;
     const int64_t keyMin = 10000;
     vector<pair<int64_t, int64_t>> insert_ops;
     unordered_map<int64_t, int64_t> base_map;
-    RBTree rb;
+    RBTree<> rb(relaxed);
     cout << "Starting insert phase" << endl;
     { // Insert test
         // Generate insert operations
@@ -103,6 +144,7 @@ void largeRandThreads(int numInserts, int numDeletes, int numThreads)
         auto rng = default_random_engine {};
         shuffle(begin(insert_ops), end(insert_ops), rng);
 
+        Maintenance maintenance(rb, relaxed);
         vector<thread> workers;
         // Spawn threads
         for (int thread_id = 0; thread_id < numThreads; thread_id++) {
@@ -118,6 +160,7 @@ void largeRandThreads(int numInserts, int numDeletes, int numThreads)
         for_each(workers.begin(), workers.end(), [](thread& t) {
             t.join();
         });
+        maintenance.finish(rb);
         unordered_set<int64_t> res;
         for(auto& p: base_map){
             res.insert(p.first);
@@ -136,6 +179,7 @@ void largeRandThreads(int numInserts, int numDeletes, int numThreads)
         auto rng = default_random_engine {};
         shuffle(begin(insert_ops), end(insert_ops), rng);
 
+        Maintenance maintenance(rb, relaxed);
         vector<thread> workers;
         // Spawn threads
         for (int thread_id = 0; thread_id < numThreads; thread_id++) {
@@ -151,6 +195,7 @@ void largeRandThreads(int numInserts, int numDeletes, int numThreads)
         for_each(workers.begin(), workers.end(), [](thread& t) {
             t.join();
         });
+        maintenance.finish(rb);
         unordered_set<int64_t> res;
         for(auto& p: base_map){
             res.insert(p.first);
@@ -159,9 +204,202 @@ void largeRandThreads(int numInserts, int numDeletes, int numThreads)
     }
 }
 
+void rangeQueries()
+{
+    cout << "Starting range queries" << endl;
+    set<int64_t> s;
+    RBTree<> rb;
+    int N = 10000;
+    for (int i = 0; i < N; i++) {
+        int64_t val = rand() % N;
+        TxBegin();
+        rb.insert(val);
+        TxEnd();
+        s.insert(val);
+    }
+
+    // Full iteration matches the ordered set
+    vector<int64_t> all;
+    TxBeginReadOnly();
+    all.clear();
+    for (RBTree<>::iterator it = rb.begin(); it != rb.end(); ++it)
+        all.push_back(*it);
+    TxEnd();
+    size_t distance;
+    TxBeginReadOnly();
+    distance = std::distance(rb.begin(), rb.end());
+    TxEnd();
+    if (all != vector<int64_t>(s.begin(), s.end()) || distance != s.size()) {
+        cout << "Iteration out of order" << endl;
+        failures++;
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        int64_t lo = rand() % N - 10;
+        int64_t hi = lo + rand() % 200;
+
+        vector<int64_t> scanned;
+        TxBeginReadOnly();
+        scanned.clear();
+        size_t count = rb.rangeCount(lo, hi);
+        rb.rangeScan(lo, hi, [&scanned](int64_t key) { scanned.push_back(key); });
+        RBTree<>::iterator lb = rb.lowerBound(lo);
+        bool lbEnd = lb == rb.end();
+        int64_t lbKey = lbEnd ? 0 : *lb;
+        TxEnd();
+
+        vector<int64_t> expected(s.lower_bound(lo), s.upper_bound(hi));
+        if (scanned != expected || count != expected.size()) {
+            cout << "Range [" << lo << ", " << hi << "] got " << scanned.size() << " keys, count " << count << " expected " << expected.size() << endl;
+            failures++;
+        }
+        auto expectedLb = s.lower_bound(lo);
+        if (lbEnd != (expectedLb == s.end()) || (!lbEnd && lbKey != *expectedLb)) {
+            cout << "lowerBound(" << lo << ") incorrect" << endl;
+            failures++;
+        }
+    }
+}
+
+// Sequential keys build long chains of red red violations in a relaxed tree
+void relaxedSequential()
+{
+    cout << "Starting relaxed sequential" << endl;
+    unordered_set<int64_t> s;
+    RBTree<> rb(true);
+    int N = 10000;
+    for (int i = 0; i < N; i++) {
+        TxBegin();
+        rb.insert(i);
+        TxEnd();
+        s.insert(i);
+        // without repairs the tree degrades into a list
+        if (i % 500 == 0)
+            rb.rebalance();
+    }
+    rb.rebalance();
+    checkOrderAndSize(s, rb);
+
+    for (int i = 0; i < N; i += 2) {
+        TxBegin();
+        rb.deleteKey(i);
+        TxEnd();
+        s.erase(i);
+    }
+    rb.rebalance();
+    checkOrderAndSize(s, rb);
+}
+
+// Values wider than a word, keys narrower than one, and a reversed order
+struct Payload {
+    int64_t a;
+    int32_t b;
+    bool operator==(const Payload& other) const { return a == other.a && b == other.b; }
+};
+
+void keyValue()
+{
+    cout << "Starting key value" << endl;
+    map<int32_t, Payload, greater<int32_t>> base;
+    RBTree<int32_t, Payload, greater<int32_t>> rb;
+    int N = 20000;
+    for (int i = 0; i < 4 * N; i++) {
+        int32_t key = rand() % N;
+        Payload p { rand(), (int32_t) rand() };
+        int op = rand() % 3;
+        bool res;
+        optional<Payload> found;
+        TxBegin();
+        found = rb.find(key);
+        if (op == 0)
+            res = rb.insert_or_assign(key, p);
+        else if (op == 1)
+            res = rb.erase(key);
+        else
+            res = rb.insert(key);
+        TxEnd();
+
+        auto it = base.find(key);
+        if (found.has_value() != (it != base.end()) || (found && !(*found == it->second))) {
+            cout << "find(" << key << ") disagrees with map" << endl;
+            failures++;
+        }
+        bool expected = op == 1 ? it != base.end() : it == base.end();
+        if (res != expected) {
+            cout << "RBTree and map disagree on op " << op << " key " << key << endl;
+            failures++;
+        }
+        if (op == 0)
+            base[key] = p;
+        else if (op == 1)
+            base.erase(key);
+        else if (it == base.end())
+            base[key] = Payload {};
+    }
+
+    vector<int32_t> keys;
+    for (auto& p : base)
+        keys.push_back(p.first);
+    if (rb.inorder() != keys || rb.size() != base.size()) {
+        cout << "RBTree with greater<> out of order" << endl;
+        failures++;
+    }
+}
+
+// Counters bumped by find then insert_or_assign, with the lookup path
+// released early. A lookup that is stale at commit shows up as a lost update
+void earlyReleaseThreads(int numOps, int numThreads)
+{
+    cout << "Starting early release with " << numThreads << " threads" << endl;
+    const int numCounters = 64;
+    RBTree<int64_t, int64_t> rb;
+    rb.setEarlyRelease(true);
+    // unrelated keys around the counters, so lookups walk a long path
+    for (int64_t i = 0; i < 20000; i++) {
+        TxBegin();
+        rb.insert_or_assign(numCounters + i, 0);
+        TxEnd();
+    }
+
+    // only the found node's key and the link to it stay
+    TxBegin();
+    rb.get(numCounters + 10000);
+    size_t readSet = _my_thread.readSetSize();
+    TxEnd();
+    if (readSet > 2) {
+        cout << "Early release kept " << readSet << " reads of a lookup" << endl;
+        failures++;
+    }
+
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&rb, thread_id, numOps, numThreads]() {
+            default_random_engine rng(thread_id);
+            for (int i = 0; i < numOps / numThreads; i++) {
+                int64_t key = rng() % numCounters;
+                TxBegin();
+                optional<int64_t> v = rb.find(key);
+                rb.insert_or_assign(key, v.value_or(0) + 1);
+                TxEnd();
+            }
+        }));
+    }
+    // Barrier
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    int64_t total = 0;
+    for (int64_t key = 0; key < numCounters; key++)
+        total += rb.find(key).value_or(0);
+    if (total != numOps / numThreads * numThreads) {
+        cout << "Early release lost updates: " << total << " of " << numOps / numThreads * numThreads << endl;
+        failures++;
+    }
+}
+
 void smallSimple()
 {
-    RBTree rb;
+    RBTree<> rb;
     rb.insert(5);
     rb.insert(3);
     rb.insert(-1);
@@ -170,21 +408,972 @@ void smallSimple()
         cout << "Failed size check" << endl;
         failures++;
     }
-    if (rb.inorder() != vector<int> { -1, 3, 5, 6 }) {
+    if (rb.inorder() != vector<int64_t> { -1, 3, 5, 6 }) {
         cout << "Out of order" << endl;
         failures++;
     }
     rb.deleteKey(5);
-    if (rb.inorder() != vector<int> { -1, 3, 6 }) {
+    if (rb.inorder() != vector<int64_t> { -1, 3, 6 }) {
         cout << "Delete failed" << endl;
         failures++;
     }
 }
 }
 
+namespace SkipListTests {
+void checkOrderAndSize(const set<int64_t>& s, SkipList& sl)
+{
+    if (s.size() != sl.size() || sl.size() != sl.sizeApprox()) {
+        cout << "SkipList and set have different sizes: " << s.size() << " " << sl.size() << " approx: " << sl.sizeApprox() << endl;
+        failures++;
+    }
+    if (sl.inorder() != vector<int64_t>(s.begin(), s.end())) {
+        cout << "SkipList out of order" << endl;
+        failures++;
+    }
+}
+
+void largeRand()
+{
+    cout << "Starting large rand" << endl;
+    set<int64_t> s;
+    SkipList sl;
+    int N = 100000;
+    for (int i = 0; i < N; i++) {
+        int64_t val = rand() % N;
+        TxBegin();
+        bool insertRes = sl.insert(val);
+        TxEnd();
+        if (insertRes != (s.count(val) == 0)) {
+            cout << "SkipList and set insertion disagree key " << val << endl;
+            failures++;
+        }
+        s.insert(val);
+    }
+    checkOrderAndSize(s, sl);
+
+    for (int i = 0; i < N / 2; i++) {
+        int64_t val = rand() % N;
+        TxBegin();
+        bool deleteRes = sl.deleteKey(val);
+        TxEnd();
+        if (deleteRes != (s.count(val) == 1)) {
+            cout << "SkipList and set deletion disagree key " << val << endl;
+            failures++;
+        }
+        s.erase(val);
+    }
+    checkOrderAndSize(s, sl);
+
+    for (int i = 0; i < 1000; i++) {
+        int64_t lo = rand() % N - 10;
+        int64_t hi = lo + rand() % 200;
+        bool found;
+        size_t count;
+        TxBeginReadOnly();
+        found = sl.get(lo);
+        count = sl.rangeCount(lo, hi);
+        TxEnd();
+        if (found != (s.count(lo) == 1) || count != (size_t) distance(s.lower_bound(lo), s.upper_bound(hi))) {
+            cout << "SkipList lookup of [" << lo << ", " << hi << "] incorrect" << endl;
+            failures++;
+        }
+    }
+}
+
+void largeRandThreads(int numOps, int numThreads)
+{
+    cout << "Starting large rand with " << numThreads << " threads" << endl;
+    const int64_t keyMax = 20000;
+    const int64_t keyMin = 10000;
+    SkipList sl;
+    // Every thread owns the keys equal to its id mod numThreads, so the final
+    // contents are known, while the shared predecessors still conflict
+    vector<set<int64_t>> expected(numThreads);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&sl, &expected, thread_id, numThreads, numOps, keyMin, keyMax]() {
+            default_random_engine rng(thread_id);
+            for (int i = 0; i < numOps / numThreads; i++) {
+                int64_t key = keyMin + (rng() % ((keyMax - keyMin) / numThreads)) * numThreads + thread_id;
+                if (rng() % 2) {
+                    TxBegin();
+                    sl.insert(key);
+                    TxEnd();
+                    expected[thread_id].insert(key);
+                } else {
+                    TxBegin();
+                    sl.deleteKey(key);
+                    TxEnd();
+                    expected[thread_id].erase(key);
+                }
+            }
+        }));
+    }
+    // Barrier
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    set<int64_t> res;
+    for (auto& e : expected)
+        res.insert(e.begin(), e.end());
+    checkOrderAndSize(res, sl);
+}
+}
+
+namespace BPlusTreeTests {
+void checkOrderAndSize(const set<int64_t>& s, BPlusTree& bt)
+{
+    if (s.size() != bt.size() || bt.size() != bt.sizeApprox()) {
+        cout << "BPlusTree and set have different sizes: " << s.size() << " " << bt.size() << " approx: " << bt.sizeApprox() << endl;
+        failures++;
+    }
+    if (bt.inorder() != vector<int64_t>(s.begin(), s.end())) {
+        cout << "BPlusTree out of order" << endl;
+        failures++;
+    }
+    // merges keep nodes from thinning out, so even after heavy deletes the
+    // tree stays well below log2 of its size
+    if (s.size() > 0 && bt.height() > log2(s.size()) + 1) {
+        cout << "BPlusTree too tall, got height: " << bt.height() << " total keys: " << s.size() << endl;
+        failures++;
+    }
+}
+
+void largeRand()
+{
+    cout << "Starting large rand" << endl;
+    set<int64_t> s;
+    BPlusTree bt;
+    int N = 100000;
+    for (int i = 0; i < N; i++) {
+        int64_t val = rand() % N;
+        TxBegin();
+        bool insertRes = bt.insert(val);
+        TxEnd();
+        if (insertRes != (s.count(val) == 0)) {
+            cout << "BPlusTree and set insertion disagree key " << val << endl;
+            failures++;
+        }
+        s.insert(val);
+    }
+    checkOrderAndSize(s, bt);
+
+    for (int i = 0; i < 1000; i++) {
+        int64_t lo = rand() % N - 10;
+        int64_t hi = lo + rand() % 200;
+        bool found;
+        size_t count;
+        TxBeginReadOnly();
+        found = bt.get(lo);
+        count = bt.rangeCount(lo, hi);
+        TxEnd();
+        if (found != (s.count(lo) == 1) || count != (size_t) distance(s.lower_bound(lo), s.upper_bound(hi))) {
+            cout << "BPlusTree lookup of [" << lo << ", " << hi << "] incorrect" << endl;
+            failures++;
+        }
+    }
+
+    // Delete almost everything so nodes merge and the tree shrinks
+    for (int i = 0; i < 4 * N; i++) {
+        int64_t val = rand() % N;
+        TxBegin();
+        bool deleteRes = bt.deleteKey(val);
+        TxEnd();
+        if (deleteRes != (s.count(val) == 1)) {
+            cout << "BPlusTree and set deletion disagree key " << val << endl;
+            failures++;
+        }
+        s.erase(val);
+    }
+    checkOrderAndSize(s, bt);
+}
+
+void largeRandThreads(int numOps, int numThreads)
+{
+    cout << "Starting large rand with " << numThreads << " threads" << endl;
+    const int64_t keyMax = 20000;
+    const int64_t keyMin = 10000;
+    BPlusTree bt;
+    // Same ownership scheme as SkipListTests::largeRandThreads
+    vector<set<int64_t>> expected(numThreads);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&bt, &expected, thread_id, numThreads, numOps, keyMin, keyMax]() {
+            default_random_engine rng(thread_id);
+            for (int i = 0; i < numOps / numThreads; i++) {
+                int64_t key = keyMin + (rng() % ((keyMax - keyMin) / numThreads)) * numThreads + thread_id;
+                if (rng() % 2) {
+                    TxBegin();
+                    bt.insert(key);
+                    TxEnd();
+                    expected[thread_id].insert(key);
+                } else {
+                    TxBegin();
+                    bt.deleteKey(key);
+                    TxEnd();
+                    expected[thread_id].erase(key);
+                }
+            }
+        }));
+    }
+    // Barrier
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    set<int64_t> res;
+    for (auto& e : expected)
+        res.insert(e.begin(), e.end());
+    checkOrderAndSize(res, bt);
+}
+}
+
+namespace DequeTests {
+void largeRand()
+{
+    cout << "Starting large rand" << endl;
+    deque<int64_t> base;
+    Deque q;
+    int N = 100000;
+    for (int i = 0; i < N; i++) {
+        int op = rand() % 6;
+        int64_t val = rand();
+        vector<int64_t> out;
+        int64_t popped = -1;
+        bool res = true;
+        TxBegin();
+        out.clear();
+        if (op == 0) {
+            q.pushBack(val);
+        } else if (op == 1) {
+            q.pushFront(val);
+        } else if (op == 2) {
+            q.pushBack(vector<int64_t> { val, val + 1, val + 2 });
+        } else if (op == 3) {
+            res = q.popFront(popped);
+        } else if (op == 4) {
+            res = q.popBack(popped);
+        } else {
+            q.popFront(3, out);
+        }
+        TxEnd();
+
+        if (op == 0) {
+            base.push_back(val);
+        } else if (op == 1) {
+            base.push_front(val);
+        } else if (op == 2) {
+            base.insert(base.end(), { val, val + 1, val + 2 });
+        } else if (op == 3 || op == 4) {
+            if (res != !base.empty() || (res && popped != (op == 3 ? base.front() : base.back()))) {
+                cout << "Deque pop disagrees with deque" << endl;
+                failures++;
+            }
+            if (!base.empty()) {
+                if (op == 3)
+                    base.pop_front();
+                else
+                    base.pop_back();
+            }
+        } else {
+            vector<int64_t> expected(base.begin(), base.begin() + min((size_t) 3, base.size()));
+            base.erase(base.begin(), base.begin() + expected.size());
+            if (out != expected) {
+                cout << "Deque batch pop disagrees with deque" << endl;
+                failures++;
+            }
+        }
+    }
+    if (base.size() != q.size() || q.size() != q.sizeApprox()) {
+        cout << "Deque and deque have different sizes: " << base.size() << " " << q.size() << endl;
+        failures++;
+    }
+}
+
+void producerConsumer(int numItems, int numThreads, int batchSize)
+{
+    cout << "Starting producer consumer with " << numThreads << " threads" << endl;
+    Deque q;
+    int numProducers = numThreads / 2;
+    atomic<int> consumed { 0 };
+    // what each consumer saw, in order
+    vector<vector<int64_t>> seen(numThreads);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&, thread_id]() {
+            if (thread_id < numProducers) {
+                // items are producer * numItems + sequence number
+                for (int i = 0; i < numItems; i += batchSize) {
+                    vector<int64_t> batch;
+                    for (int j = i; j < min(i + batchSize, numItems); j++)
+                        batch.push_back((int64_t) thread_id * numItems + j);
+                    TxBegin();
+                    q.pushBack(batch);
+                    TxEnd();
+                }
+            } else {
+                vector<int64_t> out;
+                while (consumed.load() < numItems * numProducers) {
+                    TxBegin();
+                    out.clear();
+                    q.popFront(batchSize, out);
+                    TxEnd();
+                    consumed += out.size();
+                    seen[thread_id].insert(seen[thread_id].end(), out.begin(), out.end());
+                }
+            }
+        }));
+    }
+    // Barrier
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+
+    // every item is consumed exactly once, and each consumer sees every
+    // producer's items in FIFO order
+    vector<int64_t> all;
+    for (auto& v : seen) {
+        vector<int64_t> last(numProducers, -1);
+        for (int64_t item : v) {
+            int producer = item / numItems;
+            if (item <= last[producer]) {
+                cout << "Deque consumed out of FIFO order" << endl;
+                failures++;
+                break;
+            }
+            last[producer] = item;
+        }
+        all.insert(all.end(), v.begin(), v.end());
+    }
+    sort(all.begin(), all.end());
+    vector<int64_t> expected(numItems * numProducers);
+    for (size_t i = 0; i < expected.size(); i++)
+        expected[i] = i;
+    if (all != expected || !q.empty()) {
+        cout << "Deque lost or duplicated items, consumed " << all.size() << " of " << expected.size() << endl;
+        failures++;
+    }
+}
+}
+
+namespace PriorityQueueTests {
+void largeRand(int numHeaps)
+{
+    cout << "Starting large rand with " << numHeaps << " heaps" << endl;
+    multiset<int64_t> base;
+    PriorityQueue q(numHeaps);
+    int N = 100000;
+    for (int i = 0; i < N; i++) {
+        int64_t key = rand() % N;
+        if (rand() % 3 != 0) {
+            TxBegin();
+            q.push(key);
+            TxEnd();
+            base.insert(key);
+        } else {
+            int64_t popped = -1, peeked = -1;
+            bool peekRes, popRes;
+            TxBegin();
+            peekRes = q.peek(peeked);
+            popRes = q.popMin(popped);
+            TxEnd();
+            if (popRes != !base.empty() || peekRes != popRes || (popRes && (popped != *base.begin() || peeked != popped))) {
+                cout << "PriorityQueue popMin disagrees with multiset" << endl;
+                failures++;
+            }
+            if (!base.empty())
+                base.erase(base.begin());
+        }
+    }
+    if (base.size() != q.size()) {
+        cout << "PriorityQueue and multiset have different sizes: " << base.size() << " " << q.size() << endl;
+        failures++;
+    }
+    // draining yields everything in order
+    vector<int64_t> drained;
+    int64_t key;
+    while (q.popMin(key))
+        drained.push_back(key);
+    if (drained != vector<int64_t>(base.begin(), base.end())) {
+        cout << "PriorityQueue drained out of order" << endl;
+        failures++;
+    }
+}
+
+void relaxedThreads(int numOps, int numThreads)
+{
+    cout << "Starting relaxed with " << numThreads << " threads" << endl;
+    PriorityQueue q(2 * numThreads, true);
+    // keys are unique, every pushed key must be popped exactly once
+    vector<vector<int64_t>> popped(numThreads);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&q, &popped, thread_id, numThreads, numOps]() {
+            for (int i = 0; i < numOps; i++) {
+                TxBegin();
+                q.push((int64_t) i * numThreads + thread_id);
+                TxEnd();
+                if (i % 2 == 1) {
+                    int64_t key;
+                    bool res;
+                    TxBegin();
+                    res = q.popMin(key);
+                    TxEnd();
+                    if (res)
+                        popped[thread_id].push_back(key);
+                }
+            }
+        }));
+    }
+    // Barrier
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    vector<int64_t> all;
+    for (auto& v : popped)
+        all.insert(all.end(), v.begin(), v.end());
+    int64_t key;
+    while (q.popMin(key))
+        all.push_back(key);
+    sort(all.begin(), all.end());
+    vector<int64_t> expected((size_t) numOps * numThreads);
+    for (size_t i = 0; i < expected.size(); i++)
+        expected[i] = i;
+    if (all != expected) {
+        cout << "Relaxed PriorityQueue lost or duplicated keys, got " << all.size() << " of " << expected.size() << endl;
+        failures++;
+    }
+}
+}
+
+namespace StmPolicyTests {
+// Every variant has to keep a shared counter exact. Read only transactions
+// that write have to be restarted as read-write, in every variant
+template <typename P>
+void counter(int numOps, int numThreads)
+{
+    cout << "Starting " << P::name << " counter with " << numThreads << " threads" << endl;
+    int64_t count = 0;
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&count, numOps, numThreads, thread_id]() {
+            for (int i = 0; i < numOps / numThreads; i++) {
+                if (i % 2) {
+                    TxBeginP(P);
+                    STORE(count, LOAD(count) + 1);
+                    TxEndP(P);
+                } else {
+                    TxBeginReadOnlyP(P);
+                    STORE(count, LOAD(count) + 1);
+                    TxEndP(P);
+                }
+            }
+        }));
+    }
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    if (count != numOps / numThreads * numThreads) {
+        cout << P::name << " counter is " << count << " instead of " << numOps / numThreads * numThreads << endl;
+        failures++;
+    }
+}
+}
+
+namespace StampTests {
+struct Shared {
+    float a; // shares its word with b
+    float b;
+    double d;
+    long n;
+};
+
+// The STAMP binding with explicit descriptors. Float writes must leave the
+// other half of their word alone, and STM_RESTART must retry the transaction
+void floatsAndRestart(int numOps, int numThreads)
+{
+    cout << "Starting STAMP binding with " << numThreads << " threads" << endl;
+    Shared shared { 0, 42, 0, 0 };
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&shared, numOps, numThreads, thread_id]() {
+            STM_THREAD_T* STM_SELF = STM_NEW_THREAD();
+            STM_INIT_THREAD(STM_SELF, thread_id);
+            for (int i = 0; i < numOps / numThreads; i++) {
+                volatile bool restarted = false;
+                STM_BEGIN_WR();
+                STM_WRITE_F(shared.a, STM_READ_F(shared.a) + 1);
+                STM_WRITE_F(shared.d, STM_READ_F(shared.d) + 0.5);
+                if (!restarted) {
+                    restarted = true;
+                    STM_RESTART();
+                }
+                STM_WRITE(shared.n, STM_READ(shared.n) + 1);
+                STM_END();
+            }
+            STM_FREE_THREAD(STM_SELF);
+        }));
+    }
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    long expected = numOps / numThreads * numThreads;
+    if (shared.n != expected || shared.a != (float) expected || shared.d != expected * 0.5 || shared.b != 42) {
+        cout << "STAMP binding got n=" << shared.n << " a=" << shared.a << " b=" << shared.b << " d=" << shared.d
+             << " expected n=" << expected << endl;
+        failures++;
+    }
+}
+}
+
+namespace RangeTests {
+// Unaligned ranges keep the bytes around them, and loads see the
+// transaction's own stores
+void sequential()
+{
+    cout << "Starting range sequential" << endl;
+    alignas(8) unsigned char buf[64];
+    for (int i = 0; i < 64; i++)
+        buf[i] = i;
+    unsigned char expected[64];
+    memcpy(expected, buf, 64);
+
+    unsigned char ones[13], got[20];
+    memset(ones, 1, sizeof(ones));
+    TxBegin();
+    STORE_RANGE(buf + 3, ones, sizeof(ones));
+    LOAD_RANGE(got, buf, sizeof(got));
+    MEMSET(buf + 30, 2, 5);
+    MEMCPY(buf + 41, buf + 37, 10);
+    TxEnd();
+    memset(expected + 3, 1, sizeof(ones));
+    memset(expected + 30, 2, 5);
+    memmove(expected + 41, expected + 37, 10);
+    if (memcmp(buf, expected, 64) != 0 || memcmp(got, expected, sizeof(got)) != 0) {
+        cout << "Range operations wrote or read the wrong bytes" << endl;
+        failures++;
+    }
+}
+
+#define RECORD_BYTES 37 // records share words with their neighbours
+
+// Every record is always one byte repeated. Writers copy a record over
+// another or set it to a new byte, readers check that no record is mixed
+void threads(int numOps, int numThreads)
+{
+    cout << "Starting range threads with " << numThreads << " threads" << endl;
+    const int numRecords = 16;
+    alignas(8) static unsigned char records[numRecords * RECORD_BYTES];
+    for (int i = 0; i < numRecords; i++)
+        memset(records + i * RECORD_BYTES, i, RECORD_BYTES);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([numOps, numThreads, thread_id]() {
+            mt19937 gen(thread_id);
+            for (int i = 0; i < numOps / numThreads; i++) {
+                unsigned char* a = records + gen() % numRecords * RECORD_BYTES;
+                unsigned char* b = records + gen() % numRecords * RECORD_BYTES;
+                int c = gen() % 256;
+                switch (gen() % 3) {
+                case 0:
+                    TxBegin();
+                    MEMCPY(a, b, RECORD_BYTES);
+                    TxEnd();
+                    break;
+                case 1:
+                    TxBegin();
+                    MEMSET(a, c, RECORD_BYTES);
+                    TxEnd();
+                    break;
+                default:
+                    unsigned char copy[RECORD_BYTES];
+                    TxBeginReadOnly();
+                    LOAD_RANGE(copy, a, RECORD_BYTES);
+                    TxEnd();
+                    if (count(copy, copy + RECORD_BYTES, copy[0]) != RECORD_BYTES) {
+                        cout << "Read a mixed record" << endl;
+                        failures++;
+                    }
+                }
+            }
+        }));
+    }
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    for (int i = 0; i < numRecords; i++) {
+        unsigned char* r = records + i * RECORD_BYTES;
+        if (count(r, r + RECORD_BYTES, r[0]) != RECORD_BYTES) {
+            cout << "Record " << i << " is mixed" << endl;
+            failures++;
+        }
+    }
+}
+}
+
+namespace CoTxTests {
+#define CO_ACCOUNTS 8
+#define CO_INITIAL_BALANCE 1000
+
+CoTask transfers(CoTx& tx, int64_t* accounts, int numOps, int seed)
+{
+    mt19937 gen(seed);
+    for (int i = 0; i < numOps; i++) {
+        int from = gen() % CO_ACCOUNTS;
+        int to = (from + 1 + gen() % (CO_ACCOUNTS - 1)) % CO_ACCOUNTS;
+        while (true) {
+            tx.begin(true); // starts read only, the store upgrades it
+            int64_t a, b;
+            if (!co_await tx.load(accounts[from], a) || !co_await tx.load(accounts[to], b))
+                continue;
+            if (!tx.store(accounts[from], a - 1) || !tx.store(accounts[to], b + 1))
+                continue;
+            if (co_await tx.commit())
+                break;
+        }
+    }
+}
+
+// Threads that each run several coroutine transactions, next to one that
+// runs plain ones on the same accounts. Transfers keep the total
+void bank(int numOps, int numThreads, int coroutinesPerThread)
+{
+    cout << "Starting coroutine bank with " << numThreads << " threads of " << coroutinesPerThread << " coroutines" << endl;
+    int64_t accounts[CO_ACCOUNTS];
+    fill(accounts, accounts + CO_ACCOUNTS, CO_INITIAL_BALANCE);
+    int perCoroutine = numOps / (numThreads * coroutinesPerThread);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&accounts, perCoroutine, coroutinesPerThread, thread_id]() {
+            CoScheduler sched;
+            deque<CoTx> txs;
+            for (int i = 0; i < coroutinesPerThread; i++) {
+                txs.emplace_back(sched);
+                sched.spawn(transfers(txs.back(), accounts, perCoroutine, thread_id * coroutinesPerThread + i));
+            }
+            sched.run();
+        }));
+    }
+    workers.push_back(thread([&accounts, numOps]() {
+        for (int i = 0; i < numOps / 10; i++) {
+            TxBegin();
+            STORE(accounts[i % CO_ACCOUNTS], LOAD(accounts[i % CO_ACCOUNTS]) + 1);
+            STORE(accounts[(i + 1) % CO_ACCOUNTS], LOAD(accounts[(i + 1) % CO_ACCOUNTS]) - 1);
+            TxEnd();
+        }
+    }));
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    int64_t total = 0;
+    for (int64_t balance : accounts)
+        total += balance;
+    if (total != CO_ACCOUNTS * CO_INITIAL_BALANCE) {
+        cout << "Coroutine transfers changed the total to " << total << endl;
+        failures++;
+    }
+}
+}
+
+namespace TxSiteTests {
+// Named transactions count their commits and write sets per site, and a site
+// without aborts keeps the default policy through its adapts
+void counts(int numOps, int numThreads)
+{
+    cout << "Starting call site counts with " << numThreads << " threads" << endl;
+    int64_t count = 0;
+    int perThread = numOps / numThreads;
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&count, perThread]() {
+            for (int i = 0; i < perThread; i++) {
+                TxBegin("test increment");
+                STORE(count, LOAD(count) + 1);
+                TxEnd();
+                int64_t seen;
+                TxBeginReadOnly("test read");
+                seen = LOAD(count);
+                TxEnd();
+                (void) seen;
+            }
+        }));
+    }
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    TxSite::Counts increments = txSite("test increment")->counts();
+    TxSite::Counts reads = txSite("test read")->counts();
+    if (count != perThread * numThreads || increments.commits != count || reads.commits != count) {
+        cout << "Call site counts: " << count << " increments, sites counted " << increments.commits << " and " << reads.commits << endl;
+        failures++;
+    }
+    if (increments.writeWords != count || reads.writeWords != 0) {
+        cout << "Call site write sets: " << increments.writeWords << " and " << reads.writeWords << " words" << endl;
+        failures++;
+    }
+    TxSite* read = txSite("test read");
+    if (reads.aborts == 0 && (read->backoff() || read->limit() != 0 || read->serialAfter() != TX_SITE_SERIAL_AFTER)) {
+        cout << "Call site without aborts changed its policy" << endl;
+        failures++;
+    }
+    ostringstream dump;
+    txDumpSites(dump);
+    if (dump.str().find("test increment") == string::npos) {
+        cout << "Call site missing from the dump" << endl;
+        failures++;
+    }
+}
+
+// A site fixed to run serially from the first attempt must never overlap
+// with another thread's transaction, and a limit of one never with one of
+// its own
+void serialAndLimit(int numOps, int numThreads)
+{
+    cout << "Starting serial and throttled call sites with " << numThreads << " threads" << endl;
+    txSite("test serial")->fix(false, 0, 0);
+    txSite("test limit")->fix(false, 1, TX_SITE_SERIAL_AFTER);
+    int64_t count = 0;
+    atomic<bool> serialInside { false };
+    atomic<int> limitInside { 0 };
+    atomic<int> overlaps { 0 };
+    int perThread = numOps / numThreads;
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&, perThread, thread_id]() {
+            for (int i = 0; i < perThread; i++) {
+                if (thread_id == 0 && i % 8 == 0) {
+                    TxBegin("test serial");
+                    serialInside = true;
+                    STORE(count, LOAD(count) + 1);
+                    this_thread::yield();
+                    serialInside = false;
+                    TxEnd();
+                } else if (i % 2) {
+                    TxBegin("test limit");
+                    STORE(count, LOAD(count) + 1);
+                    if (++limitInside > 1)
+                        overlaps++;
+                    limitInside--;
+                    TxEnd();
+                } else {
+                    TxBegin();
+                    if (serialInside)
+                        overlaps++;
+                    STORE(count, LOAD(count) + 1);
+                    TxEnd();
+                }
+            }
+        }));
+    }
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    TxSite::Counts serial = txSite("test serial")->counts();
+    if (count != perThread * numThreads || overlaps > 0 || serial.serial != serial.commits) {
+        cout << "Serial call site: count " << count << ", " << overlaps << " overlaps, " << serial.serial << " of "
+             << serial.commits << " commits serial" << endl;
+        failures++;
+    }
+}
+
+// A site starts read only until one of its transactions commits a write,
+// from then on read-write. Hints and upgrades only matter before that
+void readOnlyInference()
+{
+    cout << "Starting read only inference" << endl;
+    int64_t value = 0;
+    bool readOnly[3];
+    for (int i = 0; i < 3; i++) {
+        TxBegin("test infer read");
+        readOnly[i] = _my_thread.read_only;
+        (void) LOAD(value);
+        TxEnd();
+    }
+    if (!readOnly[0] || !readOnly[1] || !readOnly[2] || txSite("test infer read")->wrote()) {
+        cout << "Read only site did not run read only" << endl;
+        failures++;
+    }
+
+    int64_t abortsBefore = _my_thread.numAborts;
+    for (int i = 0; i < 3; i++) {
+        TxBeginReadOnly("test infer write");
+        readOnly[i] = _my_thread.read_only;
+        STORE(value, LOAD(value) + 1);
+        TxEnd();
+    }
+    // the first attempt of the first transaction restarts at its store
+    if (readOnly[0] || readOnly[1] || readOnly[2] || _my_thread.numAborts - abortsBefore != 1 || value != 3) {
+        cout << "Writing site: " << _my_thread.numAborts - abortsBefore << " aborts, value " << value << endl;
+        failures++;
+    }
+}
+}
+
+namespace ExclusiveTests {
+// A load phase in exclusive mode, next to threads that keep running
+// transactions on a shared counter: the mode has to wait for them and hold
+// them back, or the uninstrumented increments would race with theirs. The
+// loaded map has to work transactionally afterwards
+void loadPhase(int numKeys, int numThreads)
+{
+    cout << "Starting exclusive mode with " << numThreads << " threads" << endl;
+    int64_t count = 0;
+    atomic<bool> loaded { false };
+    atomic<int64_t> increments { 0 };
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&count, &loaded, &increments]() {
+            while (!loaded) {
+                TxBegin();
+                STORE(count, LOAD(count) + 1);
+                TxEnd();
+                increments++;
+            }
+        }));
+    }
+    HashMap m(numKeys);
+    int txBefore = _my_thread.txCount;
+    int64_t abortsBefore = _my_thread.numAborts;
+    txEnterExclusive();
+    for (int i = 0; i < numKeys; i++) {
+        TxBegin();
+        m.put(i, i);
+        STORE(count, LOAD(count) + 1);
+        TxEnd();
+    }
+    txLeaveExclusive();
+    loaded = true;
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    if (count != numKeys + increments || _my_thread.numAborts != abortsBefore || _my_thread.txCount - txBefore != numKeys) {
+        cout << "Exclusive mode: count " << count << " instead of " << numKeys + increments << endl;
+        failures++;
+    }
+    for (int i = 0; i < numKeys; i += 97) {
+        int64_t value = -1;
+        TxBegin();
+        m.get(i, value);
+        m.put(i, value + 1);
+        TxEnd();
+        TxBeginReadOnly();
+        m.get(i, value);
+        TxEnd();
+        if (value != i + 1) {
+            cout << "Exclusive mode: key " << i << " holds " << value << endl;
+            failures++;
+            break;
+        }
+    }
+}
+}
+
+namespace BaselineTests {
+// Every thread updates its own keys (key % numThreads == thread_id) against a
+// private model, through a small table so that threads share the buckets
+template <typename Map>
+void hashMapThreads(const string& name, int numOps, int numThreads)
+{
+    cout << "Starting " << name << " with " << numThreads << " threads" << endl;
+    Map m(64);
+    vector<unordered_map<int64_t, int64_t>> models(numThreads);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&m, &models, &name, numOps, numThreads, thread_id]() {
+            mt19937 gen(thread_id);
+            unordered_map<int64_t, int64_t>& model = models[thread_id];
+            for (int i = 0; i < numOps / numThreads; i++) {
+                int64_t key = gen() % 1000 * numThreads + thread_id;
+                int64_t value = -1;
+                switch (gen() % 3) {
+                case 0:
+                    m.put(key, i);
+                    model[key] = i;
+                    break;
+                case 1:
+                    m.remove(key);
+                    model.erase(key);
+                    break;
+                default:
+                    if (m.get(key, value) != (model.count(key) > 0) || (model.count(key) && value != model[key])) {
+                        cout << name << " get(" << key << ") disagrees with the model" << endl;
+                        failures++;
+                    }
+                }
+            }
+        }));
+    }
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    size_t expected = 0;
+    for (auto& model : models) {
+        expected += model.size();
+        for (auto& p : model) {
+            int64_t value = -1;
+            if (!m.get(p.first, value) || value != p.second) {
+                cout << name << " lost key " << p.first << endl;
+                failures++;
+            }
+        }
+    }
+    if (m.size() != expected) {
+        cout << name << " has size " << m.size() << " instead of " << expected << endl;
+        failures++;
+    }
+}
+
+template <typename OrderedSet>
+void orderedSetThreads(const string& name, int numOps, int numThreads)
+{
+    cout << "Starting " << name << " with " << numThreads << " threads" << endl;
+    OrderedSet s;
+    vector<set<int64_t>> models(numThreads);
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&s, &models, &name, numOps, numThreads, thread_id]() {
+            mt19937 gen(thread_id);
+            set<int64_t>& model = models[thread_id];
+            for (int i = 0; i < numOps / numThreads; i++) {
+                int64_t key = gen() % 1000 * numThreads + thread_id;
+                bool ok;
+                switch (gen() % 3) {
+                case 0:
+                    ok = s.insert(key) == model.insert(key).second;
+                    break;
+                case 1:
+                    ok = s.deleteKey(key) == (model.erase(key) > 0);
+                    break;
+                default:
+                    ok = s.get(key) == (model.count(key) > 0);
+                }
+                if (!ok) {
+                    cout << name << " disagrees with the model on key " << key << endl;
+                    failures++;
+                }
+            }
+        }));
+    }
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    set<int64_t> all;
+    for (auto& model : models)
+        all.insert(model.begin(), model.end());
+    if (s.inorder() != vector<int64_t>(all.begin(), all.end()) || s.size() != all.size()) {
+        cout << name << " has different keys than the model" << endl;
+        failures++;
+    }
+}
+}
+
 namespace HashMapTests {
 void checkCorrect(const unordered_map<int64_t, int64_t>& base, HashMap& m)
 {
+    if (base.size() != m.size() || m.size() != m.sizeApprox()) {
+        cout << "HashMap and map have different sizes: " << base.size() << " " << m.size() << " approx: " << m.sizeApprox() << endl;
+        failures++;
+    }
     for (const auto& p : base) {
         int64_t res = -1;
         if (!m.get(p.first, res)) {
@@ -226,6 +1415,44 @@ void largeRand()
     checkCorrect(base_map, m);
 }
 
+// Same as RBTreeTests::earlyReleaseThreads, with long chains to walk
+void earlyReleaseThreads(int numOps, int numThreads)
+{
+    cout << "Starting early release with " << numThreads << " threads" << endl;
+    const int numKeys = 1024;
+    HashMap m(8);
+    m.setEarlyRelease(true);
+
+    vector<thread> workers;
+    for (int thread_id = 0; thread_id < numThreads; thread_id++) {
+        workers.push_back(thread([&m, thread_id, numOps, numThreads]() {
+            default_random_engine rng(thread_id);
+            for (int i = 0; i < numOps / numThreads; i++) {
+                int64_t key = rng() % numKeys;
+                TxBegin();
+                int64_t v = 0;
+                m.get(key, v);
+                m.put(key, v + 1);
+                TxEnd();
+            }
+        }));
+    }
+    // Barrier
+    for_each(workers.begin(), workers.end(), [](thread& t) {
+        t.join();
+    });
+    int64_t total = 0;
+    for (int64_t key = 0; key < numKeys; key++) {
+        int64_t v = 0;
+        m.get(key, v);
+        total += v;
+    }
+    if (total != numOps / numThreads * numThreads) {
+        cout << "Early release lost updates: " << total << " of " << numOps / numThreads * numThreads << endl;
+        failures++;
+    }
+}
+
 void largeRandThreads(int numInserts, int numDeletes, int numThreads)
 {
     // Do a bunch of random insertions
@@ -305,8 +1532,79 @@ void run_tests()
     RBTreeTests::smallSimple();
     RBTreeTests::largeRand();
     #endif
+    RBTreeTests::rangeQueries();
+    RBTreeTests::keyValue();
+    RBTreeTests::relaxedSequential();
     #ifdef USE_STM
     RBTreeTests::largeRandThreads(1000000, 1000000, 30);
+    RBTreeTests::largeRandThreads(200000, 200000, 8, true);
+    RBTreeTests::earlyReleaseThreads(200000, 8);
+    #endif
+
+    // SkipList tests
+    cout << "Starting SkipList tests" << endl;
+    SkipListTests::largeRand();
+    #ifdef USE_STM
+    SkipListTests::largeRandThreads(400000, 8);
+    #endif
+
+    // BPlusTree tests
+    cout << "Starting BPlusTree tests" << endl;
+    BPlusTreeTests::largeRand();
+    #ifdef USE_STM
+    BPlusTreeTests::largeRandThreads(400000, 8);
+    #endif
+
+    // Deque tests
+    cout << "Starting Deque tests" << endl;
+    DequeTests::largeRand();
+    #ifdef USE_STM
+    DequeTests::producerConsumer(50000, 8, 1);
+    DequeTests::producerConsumer(50000, 8, 16);
+    #endif
+
+    // PriorityQueue tests
+    cout << "Starting PriorityQueue tests" << endl;
+    PriorityQueueTests::largeRand(1);
+    PriorityQueueTests::largeRand(4);
+    #ifdef USE_STM
+    PriorityQueueTests::relaxedThreads(50000, 8);
+    #endif
+
+    // Range operation tests
+    cout << "Starting range tests" << endl;
+    RangeTests::sequential();
+    #ifdef USE_STM
+    RangeTests::threads(200000, 8);
+    #endif
+
+    // Coroutine transaction tests
+    #ifdef USE_STM
+    cout << "Starting coroutine tests" << endl;
+    CoTxTests::bank(100000, 4, 8);
+    #endif
+
+    // Baselines without the STM
+    cout << "Starting baseline tests" << endl;
+    BaselineTests::hashMapThreads<StripedHashMap>("StripedHashMap", 200000, 8);
+    BaselineTests::hashMapThreads<LockFreeHashMap>("LockFreeHashMap", 200000, 8);
+    BaselineTests::orderedSetThreads<RWLockTree>("RWLockTree", 200000, 8);
+    BaselineTests::orderedSetThreads<LockFreeSkipList>("LockFreeSkipList", 200000, 8);
+
+    // STM variant tests
+    #ifdef USE_STM
+    cout << "Starting STM variant tests" << endl;
+    StmPolicyTests::counter<Tl2Policy>(100000, 8);
+    StmPolicyTests::counter<OptimisticReadOnlyPolicy>(100000, 8);
+    StmPolicyTests::counter<NoReadOnlyPolicy>(100000, 8);
+    StmPolicyTests::counter<BackoffPolicy>(100000, 8);
+    StmPolicyTests::counter<SchedulerPolicy>(100000, 8);
+    StmPolicyTests::counter<GlobalLockPolicy>(100000, 8);
+    StampTests::floatsAndRestart(40000, 8);
+    TxSiteTests::counts(100000, 8);
+    TxSiteTests::serialAndLimit(40000, 8);
+    TxSiteTests::readOnlyInference();
+    ExclusiveTests::loadPhase(50000, 4);
     #endif
 
     // HashMap tests
@@ -316,6 +1614,7 @@ void run_tests()
     #endif
     #ifdef USE_STM
     HashMapTests::largeRandThreads(100000, 10000, 30);
+    HashMapTests::earlyReleaseThreads(200000, 8);
     #endif
 
     if (failures > 0) {